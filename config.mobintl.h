@@ -4,9 +4,12 @@
 #define DEFAULT_FONT "Sans 14"
 #define DEFAULT_ROUNDING 5
 #define SHIFT_SPACE_IS_TAB
+#define KBD_REPEAT_DELAY 600 // ms before a held key repeats
+#define KBD_REPEAT_RATE 25   // repeats per second, 0 disables repeat
+#define KBD_LONG_PRESS_DELAY 400 // ms to hold a key for its alternates, 0 disables
 static const int transparency = 255;
 
-struct clr_scheme schemes[] = {
+static struct clr_scheme schemes[] = {
 {
   /* colors */
   .bg = {.bgra = {15, 15, 15, transparency}},
@@ -47,4 +50,13 @@ static enum layout_id landscape_layers[] = {
   NumLayouts // signals the last item, may not be omitted
 };
 
+/* layouts shown, by name, when a text field of the given content purpose gets
+ * focus (with --auto or --predict); other purposes show the first layer */
+static const char *content_purpose_layouts[NumContentPurposes] = {
+  [ContentPurposeDigits] = "dialer",
+  [ContentPurposeNumber] = "dialer",
+  [ContentPurposePhone] = "dialer",
+  [ContentPurposePin] = "dialer",
+};
+
 #endif // config_h_INCLUDED
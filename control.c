@@ -0,0 +1,330 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "control.h"
+
+struct control_client {
+    int fd;
+    bool discard; // skipping the rest of an overlong line
+    bool eof;     // the client sent all its commands
+    bool closing; // dropped, close without running more lines
+    size_t inlen, outlen;
+    char in[CONTROL_LINE_MAX];
+    char out[CONTROL_REPLY_MAX];
+};
+
+static int listen_fd = -1;
+static char *socket_path;
+static control_handler handler;
+static struct control_client clients[CONTROL_MAX_CLIENTS];
+// clients in the order their fds were handed out by control_pollfds
+static struct control_client *polled[CONTROL_MAX_CLIENTS];
+
+static void
+client_close(struct control_client *c)
+{
+    close(c->fd);
+    c->fd = -1;
+}
+
+/* Write what the socket takes of the pending replies */
+static void
+client_send(struct control_client *c)
+{
+    while (c->outlen) {
+        ssize_t n = send(c->fd, c->out, c->outlen, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                c->outlen = 0;
+                c->closing = true;
+            }
+            return;
+        }
+        c->outlen -= n;
+        memmove(c->out, c->out + n, c->outlen);
+    }
+}
+
+/* Write the replies, and close the client once it is done */
+static void
+client_flush(struct control_client *c)
+{
+    client_send(c);
+    if (c->outlen)
+        return;
+    if (c->closing || (c->eof && !memchr(c->in, '\n', c->inlen)))
+        client_close(c);
+}
+
+/* Format a reply at the end of the output, false if it doesn't fit */
+static bool
+client_format(struct control_client *c, const char *fmt, va_list ap)
+{
+    size_t room = sizeof(c->out) - c->outlen;
+    int n = vsnprintf(c->out + c->outlen, room, fmt, ap);
+
+    if (n < 0 || (size_t)n + 1 >= room)
+        return false;
+    c->outlen += n;
+    c->out[c->outlen++] = '\n';
+    return true;
+}
+
+void
+control_reply(struct control_client *c, const char *fmt, ...)
+{
+    va_list ap;
+    bool done;
+
+    va_start(ap, fmt);
+    done = client_format(c, fmt, ap);
+    va_end(ap);
+    if (done)
+        return;
+
+    // make room by sending what the client reads now
+    client_send(c);
+    if (c->closing)
+        return;
+    va_start(ap, fmt);
+    done = client_format(c, fmt, ap);
+    va_end(ap);
+
+    // a client that doesn't read its replies is dropped
+    if (!done) {
+        fprintf(stderr, "control: client not reading replies, closing\n");
+        c->outlen = 0;
+        c->closing = true;
+        return;
+    }
+}
+
+static void
+client_run_line(struct control_client *c, char *line)
+{
+    size_t len = strlen(line);
+    if (len && line[len - 1] == '\r')
+        line[--len] = '\0';
+    while (*line == ' ')
+        line++;
+    if (!*line)
+        return;
+
+    char *arg = strchr(line, ' ');
+    if (arg) {
+        *arg++ = '\0';
+        while (*arg == ' ')
+            arg++;
+    } else {
+        arg = "";
+    }
+    handler(c, line, arg);
+}
+
+/* Run the complete lines in the input buffer, those after half a buffer of
+ * replies only once the client has read them */
+static void
+client_run(struct control_client *c)
+{
+    char *start = c->in, *end = c->in + c->inlen, *nl;
+
+    while (!c->closing && (nl = memchr(start, '\n', end - start))) {
+        if (c->outlen > sizeof(c->out) / 2) {
+            client_send(c);
+            if (c->outlen > sizeof(c->out) / 2)
+                break;
+        }
+        *nl = '\0';
+        if (c->discard)
+            c->discard = false;
+        else
+            client_run_line(c, start);
+        start = nl + 1;
+    }
+    c->inlen = end - start;
+    memmove(c->in, start, c->inlen);
+
+    if (c->inlen == sizeof(c->in) && !memchr(c->in, '\n', c->inlen)) {
+        if (!c->discard)
+            control_reply(c, "error line too long");
+        c->discard = true;
+        c->inlen = 0;
+    }
+}
+
+/* Read and run commands until replies are held back */
+static void
+client_read(struct control_client *c)
+{
+    while (!c->closing && c->outlen <= sizeof(c->out) / 2) {
+        ssize_t n = read(c->fd, c->in + c->inlen, sizeof(c->in) - c->inlen);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                c->closing = true;
+            break;
+        }
+        if (n == 0) {
+            c->eof = true;
+            break;
+        }
+        c->inlen += n;
+        client_run(c);
+    }
+    // one write for all the replies of this batch
+    client_flush(c);
+}
+
+static void
+accept_clients()
+{
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        struct control_client *c = NULL;
+        for (size_t i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+            if (clients[i].fd < 0) {
+                c = &clients[i];
+                break;
+            }
+        }
+        if (!c) {
+            fprintf(stderr, "control: too many clients\n");
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->inlen = c->outlen = 0;
+        c->discard = c->eof = c->closing = false;
+    }
+}
+
+int
+control_listen(const char *path, control_handler h)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "control: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("control: socket");
+        return -1;
+    }
+
+    // Replace a stale socket, but not one another instance listens on
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "control: %s is in use\n", path);
+        close(fd);
+        return -1;
+    } else if (errno == ECONNREFUSED) {
+        unlink(path);
+    }
+    close(fd);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("control: socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, CONTROL_MAX_CLIENTS) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    for (size_t i = 0; i < CONTROL_MAX_CLIENTS; i++)
+        clients[i].fd = -1;
+    listen_fd = fd;
+    socket_path = strdup(path);
+    handler = h;
+    return 0;
+}
+
+void
+control_close(void)
+{
+    if (listen_fd < 0)
+        return;
+    for (size_t i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0)
+            client_close(&clients[i]);
+    }
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path);
+    free(socket_path);
+    socket_path = NULL;
+}
+
+size_t
+control_pollfds(struct pollfd *fds)
+{
+    size_t n = 0;
+
+    if (listen_fd < 0)
+        return 0;
+
+    fds[n].fd = listen_fd;
+    fds[n].events = POLLIN;
+    fds[n++].revents = 0;
+    for (size_t i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        struct control_client *c = &clients[i];
+        if (c->fd < 0)
+            continue;
+        polled[n - 1] = c;
+        fds[n].fd = c->fd;
+        // no more commands until the replies are read
+        fds[n].events = c->outlen ? POLLOUT : POLLIN;
+        fds[n++].revents = 0;
+    }
+    return n;
+}
+
+void
+control_dispatch(struct pollfd *fds, size_t n)
+{
+    if (listen_fd < 0 || n == 0)
+        return;
+
+    for (size_t i = 1; i < n; i++) {
+        struct control_client *c = polled[i - 1];
+        if (c->fd < 0 || c->fd != fds[i].fd)
+            continue;
+        if (fds[i].revents & POLLIN) {
+            client_read(c);
+        } else if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            client_close(c);
+        } else if (fds[i].revents & POLLOUT) {
+            client_flush(c);
+            // go on with the commands held back
+            if (c->fd >= 0 && !c->outlen) {
+                client_run(c);
+                client_flush(c);
+            }
+        }
+    }
+    if (fds[0].revents & POLLIN)
+        accept_clients();
+}
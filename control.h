@@ -0,0 +1,47 @@
+#ifndef __CONTROL_H
+#define __CONTROL_H
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Control socket
+ *
+ * A Unix stream socket taking one command per line, e.g. "layer Special".
+ * Every command gets exactly one reply line, "ok [...]" or "error ...", in
+ * the order the commands were sent. Clients may send several commands
+ * without waiting: all complete lines read at once are run together and
+ * their replies written back in one batch. Once half of CONTROL_REPLY_MAX
+ * is waiting to be read, no more commands are read or run until the client
+ * has read the replies.
+ *
+ * A line longer than CONTROL_LINE_MAX is answered with one error and skipped
+ * up to its newline. A client is dropped on a socket error, or if a reply
+ * still doesn't fit once the pending replies have been sent; the commands
+ * it sent after that are not run and get no reply.
+ */
+
+#define CONTROL_MAX_CLIENTS 8
+#define CONTROL_LINE_MAX 512
+#define CONTROL_REPLY_MAX 8192
+
+struct control_client;
+
+/* Runs one command; the line has its newline stripped and is split into the
+ * command and its (possibly empty) argument. */
+typedef void (*control_handler)(struct control_client *c, const char *cmd,
+                                const char *arg);
+
+int control_listen(const char *path, control_handler handler);
+void control_close(void);
+
+/* Fill in the fds to poll, returns how many were used (at most
+ * 1 + CONTROL_MAX_CLIENTS) */
+size_t control_pollfds(struct pollfd *fds);
+/* Handle the events polled for the fds given by control_pollfds */
+void control_dispatch(struct pollfd *fds, size_t n);
+
+void control_reply(struct control_client *c, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+#endif
@@ -1,9 +1,15 @@
+#include <stdio.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <wayland-client.h>
 
 #include "drw.h"
 #include "shm_open.h"
+#include "stats.h"
+#include "utf8.h"
+
+static void drwsurf_commit(struct drwsurf *ds, uint64_t damaged_pixels);
 #include "math.h"
 
 void drwbuf_handle_release(void *data, struct wl_buffer *wl_buffer) {
@@ -21,15 +27,23 @@ void drwsurf_handle_frame_cb(void* data, struct wl_callback* callback,
     struct drwsurf *ds = data;
     wl_callback_destroy(ds->frame_cb);
     ds->frame_cb = NULL;
+    drwsurf_flush(ds);
+}
 
+/* Commit what was drawn right away, rather than at the next frame callback */
+void
+drwsurf_flush(struct drwsurf *ds)
+{
     cairo_rectangle_int_t r = {0};
+    double pixels = 0;
     for (int i = 0; i < cairo_region_num_rectangles(ds->damage); i++) {
         cairo_region_get_rectangle(ds->damage, i, &r);
         wl_surface_damage(ds->surf, r.x, r.y, r.width, r.height);
+        pixels += (double)r.width * r.height;
     };
     cairo_region_subtract(ds->damage, ds->damage);
 
-    drwsurf_attach(ds);
+    drwsurf_commit(ds, pixels * ds->scale * ds->scale);
 }
 
 const struct wl_callback_listener frame_listener = {
@@ -44,6 +58,7 @@ void drwsurf_register_frame_cb(struct drwsurf *ds)
         return;
     ds->frame_cb = wl_surface_frame(ds->surf);
     wl_callback_add_listener(ds->frame_cb, &frame_listener, ds);
+    stats_count(StatFrameWaits, 1);
     wl_surface_commit(ds->surf);
 }
 
@@ -102,13 +117,34 @@ drwsurf_backport(struct drwsurf *ds)
     cairo_region_subtract(ds->backport_damage, ds->backport_damage);
 }
 
-void
-drwsurf_attach(struct drwsurf *ds)
+static void
+drwsurf_commit(struct drwsurf *ds, uint64_t damaged_pixels)
 {
     wl_surface_attach(ds->surf, ds->back_buffer->buf, 0, 0);
     wl_surface_commit(ds->surf);
     ds->released = false;
     ds->attached = true;
+    stats_commit(damaged_pixels);
+}
+
+void
+drwsurf_attach(struct drwsurf *ds)
+{
+    drwsurf_commit(ds, (uint64_t)ds->width * ds->height);
+}
+
+/* Unmap the surface by attaching no buffer. Its buffers are kept, and drawing
+ * goes on without frame callbacks until it is attached again. */
+void
+drwsurf_detach(struct drwsurf *ds)
+{
+    if (ds->frame_cb) {
+        wl_callback_destroy(ds->frame_cb);
+        ds->frame_cb = NULL;
+    }
+    wl_surface_attach(ds->surf, NULL, 0, 0);
+    wl_surface_commit(ds->surf);
+    ds->attached = false;
 }
 
 void
@@ -124,15 +160,135 @@ drwsurf_flip(struct drwsurf *ds)
     drwsurf_backport(ds);
 }
 
+/* Color glyphs (emoji) are rasterized once per label, font, size and scale
+ * into an image that is then copied for every draw. Going through Pango for
+ * them means font fallback and scaling a large bitmap strike every time. */
+#define SPRITE_CACHE 128
+#define SPRITE_LABEL_MAX 32
+
+struct sprite {
+    cairo_surface_t *surf; // premultiplied ARGB, NULL if the slot is unused
+    char label[SPRITE_LABEL_MAX];
+    guint font; // pango_font_description_hash
+    double scale;
+    uint32_t w, h; // layout box
+    uint32_t color;
+    int width, height; // pixel size of the text
+    int x, y;          // device offset of the image to the text origin
+};
+
+static struct sprite sprites[SPRITE_CACHE];
+static size_t sprite_next; // slot replaced next once all are used
+
+static bool
+drw_color_glyphs(const char *label)
+{
+    uint32_t cp;
+    while (*label) {
+        label += utf8_decode(label, &cp);
+        if (cp >= 0x1F000 || (cp >= 0x2600 && cp < 0x2800) || cp == 0xFE0F)
+            return true;
+    }
+    return false;
+}
+
+static struct sprite *
+drw_sprite(struct drwsurf *ds, Color color, uint32_t w, uint32_t h,
+           const char *label, PangoFontDescription *font_description)
+{
+    guint font = pango_font_description_hash(font_description);
+    for (size_t i = 0; i < SPRITE_CACHE && sprites[i].surf; i++) {
+        struct sprite *sp = &sprites[i];
+        if (sp->font == font && sp->scale == ds->scale && sp->w == w &&
+            sp->h == h && sp->color == color.color &&
+            strcmp(sp->label, label) == 0)
+            return sp;
+    }
+
+    // lay out as drw_draw_text does, then render into an image of its ink
+    struct drwbuf *d = ds->back_buffer;
+    pango_layout_set_font_description(d->layout, font_description);
+    pango_layout_set_text(d->layout, label, -1);
+    pango_layout_set_width(d->layout, w * PANGO_SCALE);
+    pango_layout_set_height(d->layout, h * PANGO_SCALE);
+    PangoRectangle ink, logical;
+    pango_layout_get_pixel_extents(d->layout, &ink, &logical);
+
+    int x0 = floor(MIN(ink.x, logical.x) * ds->scale);
+    int y0 = floor(MIN(ink.y, logical.y) * ds->scale);
+    int x1 = ceil(MAX(ink.x + ink.width, logical.x + logical.width) *
+                  ds->scale);
+    int y1 = ceil(MAX(ink.y + ink.height, logical.y + logical.height) *
+                  ds->scale);
+    cairo_surface_t *surf = cairo_image_surface_create(
+        CAIRO_FORMAT_ARGB32, MAX(x1 - x0, 1), MAX(y1 - y0, 1));
+    cairo_t *cr = cairo_create(surf);
+    cairo_translate(cr, -x0, -y0);
+    cairo_scale(cr, ds->scale, ds->scale);
+    cairo_set_source_rgba(
+        cr, color.bgra[2] / (double)255, color.bgra[1] / (double)255,
+        color.bgra[0] / (double)255, color.bgra[3] / (double)255);
+    pango_cairo_show_layout(cr, d->layout);
+    cairo_destroy(cr);
+    stats_count(StatSprites, 1);
+
+    struct sprite *sp = &sprites[sprite_next];
+    sprite_next = (sprite_next + 1) % SPRITE_CACHE;
+    if (sp->surf)
+        cairo_surface_destroy(sp->surf);
+    sp->surf = surf;
+    snprintf(sp->label, sizeof(sp->label), "%s", label);
+    sp->font = font;
+    sp->scale = ds->scale;
+    sp->w = w;
+    sp->h = h;
+    sp->color = color.color;
+    sp->width = logical.width;
+    sp->height = logical.height;
+    sp->x = x0;
+    sp->y = y0;
+    return sp;
+}
+
+static void
+drw_draw_sprite(struct drwsurf *ds, struct sprite *sp, uint32_t x, uint32_t y,
+                uint32_t w, uint32_t h)
+{
+    struct drwbuf *d = ds->back_buffer;
+    // in device pixels, on whole ones so the image is copied, not resampled
+    double ox = round(((double)(x + w / 2) - sp->width / 2) * ds->scale);
+    double oy = round(((double)(y + h / 2) - sp->height / 2) * ds->scale);
+
+    cairo_save(d->cairo);
+    cairo_identity_matrix(d->cairo);
+    cairo_set_source_surface(d->cairo, sp->surf, ox + sp->x, oy + sp->y);
+    cairo_rectangle(d->cairo, ox + sp->x, oy + sp->y,
+                    cairo_image_surface_get_width(sp->surf),
+                    cairo_image_surface_get_height(sp->surf));
+    cairo_fill(d->cairo);
+    cairo_restore(d->cairo);
+}
+
 void
 drw_draw_text(struct drwsurf *ds, Color color, uint32_t x, uint32_t y,
               uint32_t w, uint32_t h, uint32_t b, const char *label,
-              PangoFontDescription *font_description)
+              PangoFontDescription *font_description, int *extents)
 {
     drwsurf_flip(ds);
     struct drwbuf *d = ds->back_buffer;
     drwsurf_damage(ds, x, y, w, h);
 
+    if (strlen(label) < SPRITE_LABEL_MAX && drw_color_glyphs(label)) {
+        struct sprite *sp = drw_sprite(ds, color, w - b * 2, h - b * 2, label,
+                                       font_description);
+        if (extents) {
+            extents[0] = sp->width;
+            extents[1] = sp->height;
+        }
+        drw_draw_sprite(ds, sp, x, y, w, h);
+        return;
+    }
+
     cairo_save(d->cairo);
 
     pango_layout_set_font_description(d->layout, font_description);
@@ -146,8 +302,18 @@ drw_draw_text(struct drwsurf *ds, Color color, uint32_t x, uint32_t y,
     pango_layout_set_width(d->layout, (w - (b * 2)) * PANGO_SCALE);
     pango_layout_set_height(d->layout, (h - (b * 2)) * PANGO_SCALE);
 
+    // extents, if given, caches the pixel size of the text; -1 if unknown
     int width, height;
-    pango_layout_get_pixel_size(d->layout, &width, &height);
+    if (extents && extents[0] >= 0) {
+        width = extents[0];
+        height = extents[1];
+    } else {
+        pango_layout_get_pixel_size(d->layout, &width, &height);
+        if (extents) {
+            extents[0] = width;
+            extents[1] = height;
+        }
+    }
 
     cairo_rel_move_to(d->cairo, -width / 2, -height / 2);
 
@@ -155,6 +321,19 @@ drw_draw_text(struct drwsurf *ds, Color color, uint32_t x, uint32_t y,
     cairo_restore(d->cairo);
 }
 
+/* Load a font ahead of the first draw, so that font configuration and loading
+ * can be done while waiting for the compositor */
+void
+drw_preload_font(PangoFontDescription *font_description)
+{
+    PangoFontMap *map = pango_cairo_font_map_get_default();
+    PangoContext *context = pango_font_map_create_context(map);
+    PangoFont *font = pango_font_map_load_font(map, context, font_description);
+    if (font)
+        g_object_unref(font);
+    g_object_unref(context);
+}
+
 void
 drw_do_clear(struct drwsurf *ds, uint32_t x, uint32_t y, uint32_t w, uint32_t h)
 {
@@ -233,17 +412,46 @@ drw_over_rectangle(struct drwsurf *d, Color color, uint32_t x, uint32_t y,
     drw_do_rectangle(d, color, x, y, w, h, true, rounding);
 }
 
+static void
+shm_format(void *data, struct wl_shm *wl_shm, uint32_t format)
+{
+    struct drw *ctx = data;
+    if (format == WL_SHM_FORMAT_RGB565)
+        ctx->rgb565 = true;
+}
+
+const struct wl_shm_listener shm_listener = {
+    .format = shm_format,
+};
+
+/* Opaque surfaces don't need an alpha channel, which saves the compositor
+ * from blending them; ARGB8888 and XRGB8888 are always supported */
+static cairo_format_t
+cairo_format(uint32_t format)
+{
+    switch (format) {
+    case WL_SHM_FORMAT_XRGB8888:
+        return CAIRO_FORMAT_RGB24;
+    case WL_SHM_FORMAT_RGB565:
+        return CAIRO_FORMAT_RGB16_565;
+    default:
+        return CAIRO_FORMAT_ARGB32;
+    }
+}
+
 uint32_t
 setup_buffer(struct drwsurf *drwsurf, struct drwbuf *drwbuf)
 {
     int prev_size = drwbuf->size;
-    int stride = drwsurf->width * 4;
+    cairo_format_t format = cairo_format(drwsurf->format);
+    int stride = cairo_format_stride_for_width(format, drwsurf->width);
     drwbuf->size = stride * drwsurf->height;
 
     int fd = allocate_shm_file(drwbuf->size);
     if (fd == -1) {
         return 1;
     }
+    stats_count(StatShmBytes, drwbuf->size);
 
     if (drwbuf->pool_data)
         munmap(drwbuf->pool_data, prev_size);
@@ -260,7 +468,7 @@ setup_buffer(struct drwsurf *drwsurf, struct drwbuf *drwbuf)
         wl_shm_create_pool(drwsurf->ctx->shm, fd, drwbuf->size);
     drwbuf->buf =
         wl_shm_pool_create_buffer(pool, 0, drwsurf->width, drwsurf->height,
-                                  stride, WL_SHM_FORMAT_ARGB8888);
+                                  stride, drwsurf->format);
     wl_shm_pool_destroy(pool);
     close(fd);
     wl_buffer_add_listener(drwbuf->buf, &buffer_listener, drwsurf);
@@ -269,7 +477,7 @@ setup_buffer(struct drwsurf *drwsurf, struct drwbuf *drwbuf)
     if (drwbuf->cairo_surf)
         cairo_surface_destroy(drwbuf->cairo_surf);
     drwbuf->cairo_surf = cairo_image_surface_create_for_data(
-        drwbuf->pool_data, CAIRO_FORMAT_ARGB32, drwsurf->width,
+        drwbuf->pool_data, format, drwsurf->width,
         drwsurf->height, stride);
 
     if (drwbuf->cairo)
@@ -6,6 +6,7 @@
 
 struct drw {
 	struct wl_shm *shm;
+	bool rgb565; // wl_shm supports WL_SHM_FORMAT_RGB565
 };
 struct drwbuf {
 	uint32_t size;
@@ -18,6 +19,7 @@ struct drwbuf {
 struct drwsurf {
 	uint32_t width, height;
 	double scale;
+	uint32_t format; // WL_SHM_FORMAT_*, ARGB8888 (0) unless known opaque
 
 	struct drw *ctx;
 	struct wl_surface *surf;
@@ -35,6 +37,8 @@ struct kbd;
 
 void drwsurf_resize(struct drwsurf *ds, uint32_t w, uint32_t h, double s);
 void drwsurf_attach(struct drwsurf *ds);
+void drwsurf_detach(struct drwsurf *ds);
+void drwsurf_flush(struct drwsurf *ds);
 
 typedef union {
 	uint8_t bgra[4];
@@ -52,8 +56,11 @@ void drw_over_rectangle(struct drwsurf *ds, Color color, uint32_t x, uint32_t y,
 
 void drw_draw_text(struct drwsurf *ds, Color color, uint32_t x, uint32_t y,
                    uint32_t w, uint32_t h, uint32_t b, const char *label,
-                   PangoFontDescription *font_description);
+                   PangoFontDescription *font_description, int *extents);
+
+void drw_preload_font(PangoFontDescription *font_description);
 
 uint32_t setup_buffer(struct drwsurf *ds, struct drwbuf *db);
+extern const struct wl_shm_listener shm_listener;
 
 #endif
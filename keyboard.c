@@ -1,12 +1,24 @@
 #include "proto/virtual-keyboard-unstable-v1-client-protocol.h"
+#include "proto/input-method-unstable-v2-protocol.h"
+#include "proto/viewporter-client-protocol.h"
 #include <linux/input-event-codes.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <sys/mman.h>
 #include <ctype.h>
+#include <math.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
 #include "keyboard.h"
 #include "drw.h"
+#include "keymappack.h"
 #include "os-compatibility.h"
+#include "predict.h"
+#include "stats.h"
+#include "stream.h"
+#include "swipe.h"
+#include "utf8.h"
 
 #define MAX_LAYERS 25
 
@@ -15,13 +27,40 @@
     fprintf(stderr, __VA_ARGS__);                                              \
     exit(1)
 
-#ifndef KEYMAP
-#error "make sure to define KEYMAP"
+#ifndef LAYOUTSETS
+#error "make sure to define LAYOUTSETS"
 #endif
-#include KEYMAP
 
+static bool drawing_layout; // kbd_draw_key is drawing a whole layout
+static const char *kbd_find_keymap(struct kbd *kb, const char *name);
+
+/* LAYOUTSETS lists LAYOUTSET(name) for each family in LAYOUTS */
+#define LAYOUTSET(name) struct layoutset *layoutset_##name(void);
+LAYOUTSETS
+#undef LAYOUTSET
+#define LAYOUTSET(name) {#name, layoutset_##name},
+const struct builtin_layoutset builtin_layoutsets[] = {LAYOUTSETS};
+#undef LAYOUTSET
+const size_t builtin_layoutsetcount =
+    sizeof(builtin_layoutsets) / sizeof(*builtin_layoutsets);
+void (*kbd_layoutset_setup)(struct layoutset *ls);
+
+/* The compiled-in family of that name, set up on first use. NULL if there is
+ * none. */
+struct layoutset *
+kbd_builtin_layoutset(const char *name)
+{
+    for (size_t i = 0; i < builtin_layoutsetcount; i++) {
+        if (!strcmp(builtin_layoutsets[i].name, name))
+            return builtin_layoutsets[i].get();
+    }
+    return NULL;
+}
+
+/* Switch layouts without drawing, for when the keyboard isn't shown yet: the
+ * layout is drawn with the first frame */
 void
-kbd_switch_layout(struct kbd *kb, struct layout *l, size_t layer_index)
+kbd_set_layout(struct kbd *kb, struct layout *l, size_t layer_index)
 {
     kb->prevlayout = kb->layout;
     if ((kb->layer_index != kb->last_abc_index) && (kb->layout->abc)) {
@@ -30,6 +69,7 @@ kbd_switch_layout(struct kbd *kb, struct layout *l, size_t layer_index)
     }
     kb->layer_index = layer_index;
     kb->layout = l;
+    kbd_prepare_layout(kb, l);
     if (kb->debug)
         fprintf(stderr, "Switching to layout %s, layer_index %ld\n",
                 kb->layout->name, layer_index);
@@ -37,16 +77,35 @@ kbd_switch_layout(struct kbd *kb, struct layout *l, size_t layer_index)
         fprintf(stderr, "Layout has no keymap!"); // sanity check
     if ((!kb->prevlayout) ||
         (strcmp(kb->prevlayout->keymap_name, kb->layout->keymap_name) != 0)) {
-        fprintf(stderr, "Switching to keymap %s\n", kb->layout->keymap_name);
-        create_and_upload_keymap(kb, kb->layout->keymap_name, 0);
+        int combined = kb->combined;
+        kbd_find_keymap(kb, kb->layout->keymap_name);
+        if (kb->prevlayout && combined >= 0 && kb->combined == combined) {
+            // a group of the keymap already uploaded
+            fprintf(stderr, "Switching to keymap %s, group %d\n",
+                    kb->layout->keymap_name, kb->group + 1);
+            zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0,
+                                              kb->group);
+        } else {
+            fprintf(stderr, "Switching to keymap %s\n",
+                    kb->layout->keymap_name);
+            create_and_upload_keymap(kb, kb->layout->keymap_name, 0);
+        }
     }
+}
+
+void
+kbd_switch_layout(struct kbd *kb, struct layout *l, size_t layer_index)
+{
+    kbd_set_layout(kb, l, layer_index);
     kbd_draw_layout(kb);
 }
 
 void
-kbd_next_layer(struct kbd *kb, struct key *k, bool invert)
+kbd_next_layer(struct kbd *kb, const struct key *k, bool invert)
 {
     size_t layer_index = kb->layer_index;
+    size_t layercount =
+        kb->landscape ? kb->landscape_layercount : kb->layercount;
     if ((kb->mods & Ctrl) || (kb->mods & Alt) || (kb->mods & AltGr) ||
         ((bool)kb->compose)) {
         // with modifiers ctrl/alt/altgr: switch to the first layer
@@ -58,16 +117,6 @@ kbd_next_layer(struct kbd *kb, struct key *k, bool invert)
         if (layer_index > 0) {
             layer_index--;
         } else {
-            size_t layercount = 0;
-            for (size_t i = 0; layercount == 0; i++) {
-                if (kb->landscape) {
-                    if (kb->landscape_layers[i] == NumLayouts)
-                        layercount = i;
-                } else {
-                    if (kb->layers[i] == NumLayouts)
-                        layercount = i;
-                }
-            }
             layer_index = layercount - 1;
         }
         if (!invert)
@@ -76,22 +125,12 @@ kbd_next_layer(struct kbd *kb, struct key *k, bool invert)
         // normal behaviour: switch to the next layout in the layer sequence
         layer_index++;
     }
-    size_t layercount = 0;
-    for (size_t i = 0; layercount == 0; i++) {
-        if (kb->landscape) {
-            if (kb->landscape_layers[i] == NumLayouts)
-                layercount = i;
-        } else {
-            if (kb->layers[i] == NumLayouts)
-                layercount = i;
-        }
-    }
     if (layer_index >= layercount) {
         if (kb->debug)
             fprintf(stderr, "wrapping layer_index back to start\n");
         layer_index = 0;
     }
-    enum layout_id layer;
+    size_t layer;
     if (kb->landscape) {
         layer = kb->landscape_layers[layer_index];
     } else {
@@ -108,7 +147,7 @@ uint8_t
 kbd_get_rows(struct layout *l)
 {
     uint8_t rows = 0;
-    struct key *k = l->keys;
+    const struct key *k = l->keys;
     while (k->type != Last) {
         if (k->type == EndRow) {
             rows++;
@@ -118,26 +157,30 @@ kbd_get_rows(struct layout *l)
     return rows + 1;
 }
 
-enum layout_id *
-kbd_init_layers(char *layer_names_list)
+/* The layouts named in a comma separated list, NULL if one isn't there */
+size_t *
+kbd_init_layers(struct layoutset *ls, char *layer_names_list, size_t *count)
 {
-    enum layout_id *layers;
-    uint8_t numlayers = 0;
+    size_t *layers;
+    size_t numlayers = 0;
     bool found;
     char *s;
-    int i;
+    size_t i;
 
-    layers = malloc(MAX_LAYERS * sizeof(enum layout_id));
+    layers = malloc(MAX_LAYERS * sizeof(size_t));
     s = strtok(layer_names_list, ",");
     while (s != NULL) {
         if (numlayers + 1 == MAX_LAYERS) {
-            fprintf(stderr, "too many layers specified");
-            exit(3);
+            fprintf(stderr, "too many layers specified\n");
+            free(layers);
+            return NULL;
         }
         found = false;
-        for (i = 0; i < NumLayouts - 1; i++) {
-            if (layouts[i].name && strcmp(layouts[i].name, s) == 0) {
-                fprintf(stderr, "layer #%d = %s\n", numlayers + 1, s);
+        for (i = 0; i < ls->layoutcount; i++) {
+            if (i == ls->index)
+                continue;
+            if (ls->layouts[i].name && strcmp(ls->layouts[i].name, s) == 0) {
+                fprintf(stderr, "layer #%ld = %s\n", numlayers + 1, s);
                 layers[numlayers++] = i;
                 found = true;
                 break;
@@ -145,49 +188,40 @@ kbd_init_layers(char *layer_names_list)
         }
         if (!found) {
             fprintf(stderr, "No such layer: %s\n", s);
-            exit(3);
+            free(layers);
+            return NULL;
         }
         s = strtok(NULL, ",");
     }
-    layers[numlayers] = NumLayouts; // mark the end of the sequence
     if (numlayers == 0) {
         fprintf(stderr, "No layers defined\n");
-        exit(3);
+        free(layers);
+        return NULL;
     }
 
+    *count = numlayers;
     return layers;
 }
 
-void
-kbd_init(struct kbd *kb, struct layout *layouts, char *layer_names_list,
-         char *landscape_layer_names_list)
+/* Use the layouts of a layout set, starting at its first layer */
+static void
+kbd_use_layoutset(struct kbd *kb, struct layoutset *layoutset)
 {
-    int i;
+    kb->layoutset = layoutset;
+    kb->layouts = layoutset->layouts;
 
-    fprintf(stderr, "Initializing keyboard\n");
-
-    kb->layouts = layouts;
-
-    for (i = 0; i < NumLayouts - 1; i++)
-        ;
-    fprintf(stderr, "Found %d layouts\n", i);
+    fprintf(stderr, "Found %ld layouts\n", layoutset->layoutcount - 1);
 
     kb->layer_index = 0;
     kb->last_abc_index = 0;
+    kb->layers = layoutset->layers;
+    kb->layercount = layoutset->layercount;
+    kb->landscape_layers = layoutset->landscape_layers;
+    kb->landscape_layercount = layoutset->landscape_layercount;
 
-    if (layer_names_list)
-        kb->layers = kbd_init_layers(layer_names_list);
-    if (landscape_layer_names_list)
-        kb->landscape_layers = kbd_init_layers(landscape_layer_names_list);
+    fprintf(stderr, "Found %ld layers\n", kb->layercount);
 
-    i = 0;
-    enum layout_id lid = kb->layers[0];
-    while (lid != NumLayouts) {
-        lid = kb->layers[++i];
-    }
-    fprintf(stderr, "Found %d layers\n", i);
-
-    enum layout_id layer;
+    size_t layer;
     if (kb->landscape) {
         layer = kb->landscape_layers[kb->layer_index];
     } else {
@@ -196,8 +230,87 @@ kbd_init(struct kbd *kb, struct layout *layouts, char *layer_names_list,
 
     kb->layout = &kb->layouts[layer];
     kb->last_abc_layout = &kb->layouts[layer];
+    kb->shift_space_is_tab = layoutset->shift_space_is_tab;
+
+    /* the tables of the first layouts shown don't depend on the geometry */
+    kbd_init_layout_tables(&kb->layouts[kb->layers[0]]);
+    kbd_init_layout_tables(&kb->layouts[kb->landscape_layers[0]]);
+}
+
+void
+kbd_init(struct kbd *kb, struct layoutset *layoutset, char *layer_names_list,
+         char *landscape_layer_names_list)
+{
+    fprintf(stderr, "Initializing keyboard\n");
 
-    /* upload keymap */
+    // the layers given replace the default ones of the layout set
+    if (layer_names_list &&
+        !(layoutset->layers = kbd_init_layers(layoutset, layer_names_list,
+                                              &layoutset->layercount)))
+        exit(3);
+    if (landscape_layer_names_list &&
+        !(layoutset->landscape_layers =
+              kbd_init_layers(layoutset, landscape_layer_names_list,
+                              &layoutset->landscape_layercount)))
+        exit(3);
+    kbd_use_layoutset(kb, layoutset);
+
+    /* prepare the keymap, it is uploaded once the virtual keyboard exists */
+    kb->combined = -1;
+    kb->keymap_fd = kbd_prepare_keymap(kb, kb->layout->keymap_name, 0,
+                                       &kb->keymap_size);
+}
+
+/* The layer sequences of the layout set changed: the layout shown stays, at
+ * its place in the new sequence if it has one */
+void
+kbd_update_layers(struct kbd *kb)
+{
+    struct layoutset *ls = kb->layoutset;
+
+    kb->layers = ls->layers;
+    kb->layercount = ls->layercount;
+    kb->landscape_layers = ls->landscape_layers;
+    kb->landscape_layercount = ls->landscape_layercount;
+
+    size_t *layers = kb->landscape ? kb->landscape_layers : kb->layers;
+    size_t layercount =
+        kb->landscape ? kb->landscape_layercount : kb->layercount;
+    kb->layer_index = 0;
+    for (size_t i = 0; i < layercount; i++) {
+        if (&kb->layouts[layers[i]] == kb->layout)
+            kb->layer_index = i;
+    }
+    if (kb->last_abc_index >= layercount) {
+        kb->last_abc_index = 0;
+        kb->last_abc_layout = &kb->layouts[layers[0]];
+    }
+}
+
+/* The fonts changed: the text extents cached for the layouts are measured
+ * again when they are next drawn */
+void
+kbd_reshape(struct kbd *kb)
+{
+    for (size_t i = 0; i < kb->layoutset->layoutcount; i++) {
+        struct layout *l = &kb->layouts[i];
+        for (size_t k = 0; l->meta && k < l->keycount; k++)
+            memset(l->meta[k].extents, -1, sizeof(l->meta[k].extents));
+    }
+}
+
+/* Switch to another layout set and upload the keymap of its first layer. The
+ * caller lays out and draws it, as after a rotation. */
+void
+kbd_set_layoutset(struct kbd *kb, struct layoutset *ls)
+{
+    if (ls == kb->layoutset)
+        return;
+    fprintf(stderr, "Switching to layout set %s\n", ls->name ? ls->name : "");
+    kbd_use_layoutset(kb, ls);
+    kb->prevlayout = kb->layout;
+    kb->compose = 0;
+    kb->combined = -1;
     create_and_upload_keymap(kb, kb->layout->keymap_name, 0);
 }
 
@@ -209,33 +322,168 @@ kbd_init_layout(struct layout *l, uint32_t width, uint32_t height)
 
     l->keyheight = height / rows;
 
-    struct key *k = l->keys;
+    const struct key *k = l->keys;
+    struct key_rect *r = l->rects;
+    if (l->meta) {
+        // text extents depend on the key size
+        for (size_t i = 0; i < l->keycount; i++)
+            memset(l->meta[i].extents, -1, sizeof(l->meta[i].extents));
+    }
     double rowlength = kbd_get_row_length(k);
     double rowwidth = 0.0;
     while (k->type != Last) {
+        *r = (struct key_rect){0};
         if (k->type == EndRow) {
             y += l->keyheight;
             x = 0;
             rowwidth = 0.0;
             rowlength = kbd_get_row_length(k + 1);
         } else if (k->width > 0) {
-            k->x = x;
-            k->y = y;
-            k->w = ((double)width / rowlength) * k->width;
-            x += k->w;
+            uint32_t w = ((double)width / rowlength) * k->width;
+            r->x = x;
+            r->y = y;
+            x += w;
             rowwidth += k->width;
             if (x < (rowwidth / rowlength) * (double)width) {
-                k->w++;
+                w++;
                 x++;
             }
+            // padding takes up space but is never drawn or hit
+            if (k->type != Pad) {
+                r->w = w;
+                r->h = l->keyheight;
+            }
         }
-        k->h = l->keyheight;
         k++;
+        r++;
+    }
+    *r = (struct key_rect){0};
+}
+
+static void
+kbd_init_key_meta(struct key_meta *m, const struct key *k)
+{
+    const char *label = k->label ? k->label : "";
+    const char *shift_label = k->shift_label ? k->shift_label : label;
+
+    m->alpha = label[0] && !label[1] && isalpha((unsigned char)label[0]);
+    m->label[LabelPlain] = label;
+    m->label[LabelShift] = shift_label;
+    m->label[LabelCaps] = m->alpha ? shift_label : label;
+    for (int i = 0; i < NumLabelStates; i++)
+        m->len[i] = strlen(m->label[i]);
+    m->shift_changes = strcmp(label, shift_label) != 0;
+    memset(m->extents, -1, sizeof(m->extents));
+}
+
+/* Allocate the rect and label tables of a layout, once */
+void
+kbd_init_layout_tables(struct layout *l)
+{
+    if (l->rects)
+        return;
+
+    const struct key *k = l->keys;
+    while (k->type != Last)
+        k++;
+    l->keycount = k - l->keys + 1;
+    l->rects = calloc(l->keycount, sizeof(struct key_rect));
+    l->meta = calloc(l->keycount, sizeof(struct key_meta));
+    for (size_t i = 0; i < l->keycount; i++)
+        kbd_init_key_meta(&l->meta[i], &l->keys[i]);
+}
+
+/* Key geometry is computed lazily, the first time a layout is shown after a
+ * resize, rather than for every layout on every resize. */
+void
+kbd_prepare_layout(struct kbd *kb, struct layout *l)
+{
+    if (l->generation == kb->generation)
+        return;
+    if (kb->debug) {
+        if (l->name)
+            fprintf(stderr, "Initialising layout %s, keymap %s\n", l->name,
+                    l->keymap_name);
+        else
+            fprintf(stderr, "Initialising unnamed layout, keymap %s\n",
+                    l->keymap_name);
+    }
+    kbd_init_layout_tables(l);
+    kbd_init_layout(l, kb->w, kb->h - kb->prediction_h);
+    // keys go below the prediction strip
+    for (size_t i = 0; kb->prediction_h && i < l->keycount; i++)
+        l->rects[i].y += kb->prediction_h;
+    l->generation = kb->generation;
+}
+
+/* geometry of a key of the current layout, NULL for keys that aren't shown */
+static struct key_rect *
+kbd_key_rect(struct kbd *kb, const struct key *k)
+{
+    struct layout *l = kb->layout;
+    if (!l->rects || k < l->keys || k >= l->keys + l->keycount)
+        return NULL;
+    return &l->rects[k - l->keys];
+}
+
+static struct key_meta *
+kbd_layout_key_meta(struct layout *l, const struct key *k)
+{
+    if (!l->meta || k < l->keys || k >= l->keys + l->keycount)
+        return NULL;
+    return &l->meta[k - l->keys];
+}
+
+/* label data of a key of the current layout, or of the last alternates */
+static struct key_meta *
+kbd_key_meta(struct kbd *kb, const struct key *k)
+{
+    struct key_meta *m = kbd_layout_key_meta(kb->layout, k);
+    if (!m && kb->alternates.layout)
+        m = kbd_layout_key_meta(kb->alternates.layout, k);
+    return m;
+}
+
+static enum key_label_state
+kbd_label_state(uint8_t mods)
+{
+    if (mods & Shift)
+        return LabelShift;
+    if (mods & CapsLock)
+        return LabelCaps;
+    return LabelPlain;
+}
+
+/* Redraw only what a change of modifiers affects: keys whose label differs
+ * between the old and the new state and modifier keys that were toggled. */
+static void
+kbd_draw_mods_changed(struct kbd *kb, uint8_t old_mods)
+{
+    struct layout *l = kb->layout;
+    enum key_label_state from = kbd_label_state(old_mods);
+    enum key_label_state to = kbd_label_state(kb->mods);
+    uint8_t changed = old_mods ^ kb->mods;
+
+    kbd_prepare_layout(kb, l);
+    for (size_t i = 0; i < l->keycount; i++) {
+        const struct key *k = &l->keys[i];
+        const struct key_meta *m = &l->meta[i];
+        if ((k->type == Pad) || (k->type == EndRow) || (k->type == Last))
+            continue;
+        if (!(m->shift_changes && m->label[from] != m->label[to]) &&
+            !(k->type == Mod && (changed & k->code)))
+            continue;
+        if ((k->type == Mod && kb->mods & k->code) ||
+            (k->type == Compose && kb->compose)) {
+            kbd_draw_key(kb, k, Press);
+        } else {
+            kbd_draw_key(kb, k, None);
+        }
     }
 }
 
 double
-kbd_get_row_length(struct key *k)
+kbd_get_row_length(const struct key *k)
 {
     double l = 0.0;
     while ((k->type != Last) && (k->type != EndRow)) {
@@ -245,20 +493,20 @@ kbd_get_row_length(struct key *k)
     return l;
 }
 
-struct key *
+const struct key *
 kbd_get_key(struct kbd *kb, uint32_t x, uint32_t y)
 {
     struct layout *l = kb->layout;
-    struct key *k = l->keys;
+    const struct key_rect *r = l->rects;
     if (kb->debug)
         fprintf(stderr, "get key: +%d+%d\n", x, y);
-    while (k->type != Last) {
-        if ((k->type != EndRow) && (k->type != Pad) && (k->type != Pad) &&
-            (x >= k->x) && (y >= k->y) && (x < k->x + k->w) &&
-            (y < k->y + k->h)) {
-            return k;
+    if (!r)
+        return NULL;
+    // empty rectangles (padding, row ends) never match
+    for (size_t i = 0; i < l->keycount; i++, r++) {
+        if ((x - r->x < r->w) && (y - r->y < r->h)) {
+            return &l->keys[i];
         }
-        k++;
     }
     return NULL;
 }
@@ -266,36 +514,530 @@ kbd_get_key(struct kbd *kb, uint32_t x, uint32_t y)
 size_t
 kbd_get_layer_index(struct kbd *kb, struct layout *l)
 {
-    for (size_t i = 0; i < NumLayouts - 1; i++) {
-        if (l == &kb->layouts[i]) {
+    for (size_t i = 0; i < kb->layoutset->layoutcount; i++) {
+        if (i != kb->layoutset->index && l == &kb->layouts[i]) {
             return i;
         }
     }
     return 0;
 }
 
+/* Every key event sent goes through here, to be counted */
+static void
+kbd_send_key(struct zwp_virtual_keyboard_v1 *vkbd, uint32_t time, uint32_t key,
+             uint32_t state)
+{
+    zwp_virtual_keyboard_v1_key(vkbd, time, key, state);
+    stats_count(StatKeyEvents, 1);
+}
+
 void
 zwp_virtual_keyboard_v1_key_mods(struct zwp_virtual_keyboard_v1 *vkbd, uint32_t time, uint32_t mods, enum wl_keyboard_key_state state)
 {
     if ((mods & Shift) == Shift)
-        zwp_virtual_keyboard_v1_key(vkbd, time, KEY_LEFTSHIFT, state);
+        kbd_send_key(vkbd, time, KEY_LEFTSHIFT, state);
     if ((mods & CapsLock) == CapsLock)
-        zwp_virtual_keyboard_v1_key(vkbd, time, KEY_CAPSLOCK, state);
+        kbd_send_key(vkbd, time, KEY_CAPSLOCK, state);
     if ((mods & Ctrl) == Ctrl)
-        zwp_virtual_keyboard_v1_key(vkbd, time, KEY_LEFTCTRL, state);
+        kbd_send_key(vkbd, time, KEY_LEFTCTRL, state);
     if ((mods & Alt) == Alt)
-        zwp_virtual_keyboard_v1_key(vkbd, time, KEY_LEFTALT, state);
+        kbd_send_key(vkbd, time, KEY_LEFTALT, state);
     if ((mods & Super) == Super)
-        zwp_virtual_keyboard_v1_key(vkbd, time, KEY_LEFTMETA, state);
+        kbd_send_key(vkbd, time, KEY_LEFTMETA, state);
     if ((mods & AltGr) == AltGr)
-        zwp_virtual_keyboard_v1_key(vkbd, time, KEY_RIGHTALT, state);
+        kbd_send_key(vkbd, time, KEY_RIGHTALT, state);
+}
+
+static uint64_t
+kbd_now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Start repeating a key that was just pressed, after the repeat delay */
+static void
+kbd_arm_repeat(struct kbd *kb, uint32_t code, uint32_t time)
+{
+    if (kb->repeat_fd < 0 || !kb->repeat_rate)
+        return;
+
+    uint32_t interval = 1000 / kb->repeat_rate;
+    struct itimerspec its = {
+        .it_value = {kb->repeat_delay / 1000,
+                     (kb->repeat_delay % 1000) * 1000000},
+        .it_interval = {interval / 1000, (interval % 1000) * 1000000},
+    };
+    if (!kb->repeat_delay)
+        its.it_value.tv_nsec = 1; // zero would disarm the timer
+    kb->repeat_code = code;
+    kb->repeat_time = time;
+    kb->repeat_start = kbd_now_ms();
+    timerfd_settime(kb->repeat_fd, 0, &its, NULL);
+}
+
+static void
+kbd_disarm_repeat(struct kbd *kb)
+{
+    struct itimerspec its = {0};
+    if (!kb->repeat_code)
+        return;
+    kb->repeat_code = 0;
+    timerfd_settime(kb->repeat_fd, 0, &its, NULL);
+}
+
+static void kbd_predict_key(struct kbd *kb, const struct key *k);
+
+/* The repeat timer expired: send the held key again. It is released and
+ * pressed, so that clients see distinct presses and don't start repeating
+ * it themselves. Nothing is redrawn. */
+void
+kbd_repeat(struct kbd *kb)
+{
+    uint64_t expirations;
+    if (read(kb->repeat_fd, &expirations, sizeof(expirations)) !=
+        sizeof(expirations))
+        return;
+    if (!kb->repeat_code || !kb->last_press)
+        return;
+
+    // event times continue from the time of the press
+    uint32_t time = kb->repeat_time + (kbd_now_ms() - kb->repeat_start);
+    kbd_send_key(kb->vkbd, time, kb->repeat_code,
+                 WL_KEYBOARD_KEY_STATE_RELEASED);
+    kbd_send_key(kb->vkbd, time, kb->repeat_code,
+                 WL_KEYBOARD_KEY_STATE_PRESSED);
+    if (kb->print || kb->print_intersect)
+        kbd_output_key(kb, kb->last_press, StreamRepeat, time);
+    if (kb->predict)
+        kbd_predict_key(kb, kb->last_press);
+}
+
+/* Keys with a layout (the compose layouts) offer its characters when held,
+ * unless the long press delay is 0. Their press is only sent on release, once
+ * it is known not to be a long one.
+ */
+static bool
+kbd_has_alternates(struct kbd *kb, const struct key *k)
+{
+    return kb->long_press_delay && !kb->print_intersect && !kb->compose &&
+           k->type == Code && k->layout;
+}
+
+/* The letter a key types when swiped over, 0 if it can't be swiped */
+static uint32_t
+kbd_swipe_letter(struct kbd *kb, const struct key *k)
+{
+    const struct key_meta *m = kbd_key_meta(kb, k);
+    uint32_t cp;
+
+    if (k->type != Code || !m || !m->len[LabelPlain] ||
+        utf8_decode(m->label[LabelPlain], &cp) != m->len[LabelPlain])
+        return 0;
+    return (cp >= 0x80 || isalpha(cp)) ? cp : 0;
+}
+
+/* Letters start a swipe when the finger moves on to another key, so their
+ * press is also held back until release when swipe typing */
+static bool
+kbd_swipeable(struct kbd *kb, const struct key *k)
+{
+    return kb->swipe_typing && !kb->print_intersect && !kb->compose &&
+           kbd_swipe_letter(kb, k);
+}
+
+static void
+kbd_hold_key(struct kbd *kb, const struct key *k, uint32_t time)
+{
+    kb->pending_key = k;
+    kb->pending_time = time;
+    kb->pending_x = kb->touch_x;
+    kb->pending_y = kb->touch_y;
+    kbd_draw_key(kb, k, Press);
+    if (kbd_has_alternates(kb, k)) {
+        struct itimerspec its = {
+            .it_value = {kb->long_press_delay / 1000,
+                         (kb->long_press_delay % 1000) * 1000000},
+        };
+        timerfd_settime(kb->long_press_fd, 0, &its, NULL);
+    }
+}
+
+static void
+kbd_disarm_long_press(struct kbd *kb)
+{
+    struct itimerspec its = {0};
+    if (kb->long_press_fd >= 0)
+        timerfd_settime(kb->long_press_fd, 0, &its, NULL);
+}
+
+static void
+kbd_draw_alternate(struct kbd *kb, size_t i)
+{
+    struct alternates *a = &kb->alternates;
+    struct clr_scheme *scheme = &kb->schemes[kb->pending_key->scheme];
+    const struct key_meta *m = kbd_layout_key_meta(a->layout, a->keys[i]);
+    uint32_t x = a->x + (i % a->cols) * a->w;
+    uint32_t y = a->y + (a->rows - 1 - i / a->cols) * a->h;
+    bool selected = i == a->selected;
+    uint32_t border = kb->layoutset->key_border;
+
+    // the text extents cached in the meta are for the layout's own geometry
+    draw_inset(kb->popup_surf, x, y, a->w, a->h, border,
+               selected ? scheme->high : scheme->fg, scheme->rounding);
+    drw_draw_text(kb->popup_surf, selected ? scheme->text_press : scheme->text,
+                  x, y, a->w, a->h, border,
+                  m->label[kbd_label_state(kb->mods)],
+                  scheme->font_description, NULL);
+}
+
+static void
+kbd_hide_alternates(struct kbd *kb)
+{
+    struct alternates *a = &kb->alternates;
+    drw_do_clear(kb->popup_surf, a->x, a->y, a->cols * a->w, a->rows * a->h);
+    a->count = 0;
+    kbd_draw_key(kb, kb->pending_key, Unpress);
+    kb->pending_key = NULL;
+}
+
+/* Select the alternate under the finger; outside the grid the nearest one */
+static void
+kbd_select_alternate(struct kbd *kb, uint32_t x, uint32_t y)
+{
+    struct alternates *a = &kb->alternates;
+    int32_t px = (int32_t)x - (int32_t)a->x;
+    int32_t py = (int32_t)y + (int32_t)kb->h - (int32_t)a->y;
+    uint32_t col = px < 0 ? 0 : px / a->w;
+    uint32_t row = py < 0 ? 0 : py / a->h;
+    if (col >= a->cols)
+        col = a->cols - 1;
+    if (row >= a->rows)
+        row = a->rows - 1;
+
+    size_t i = (a->rows - 1 - row) * a->cols + col;
+    if (i >= a->count)
+        i = a->count - 1;
+    if (i != a->selected) {
+        size_t old = a->selected;
+        a->selected = i;
+        kbd_draw_alternate(kb, old);
+        kbd_draw_alternate(kb, i);
+    }
+}
+
+/* The long press timer expired: show the alternates of the held key over the
+ * popup surface. The layout underneath is left as it is. */
+void
+kbd_long_press(struct kbd *kb)
+{
+    uint64_t expirations;
+    if (read(kb->long_press_fd, &expirations, sizeof(expirations)) !=
+        sizeof(expirations))
+        return;
+
+    const struct key *k = kb->pending_key;
+    const struct key_rect *r;
+    struct alternates *a = &kb->alternates;
+    if (!k || a->count || kb->swiping || !(r = kbd_key_rect(kb, k)) ||
+        !r->w || !r->h)
+        return;
+
+    struct layout *l = k->layout;
+    kbd_init_layout_tables(l);
+    a->layout = l;
+    for (size_t i = 0; i < l->keycount && a->count < KBD_MAX_ALTERNATES; i++) {
+        const struct key *alt = &l->keys[i];
+        if ((alt->type == Code || alt->type == Copy) &&
+            l->meta[i].len[LabelPlain])
+            a->keys[a->count++] = alt;
+    }
+    if (!a->count)
+        return;
+
+    // cells the size of the key, in rows growing upwards from above the key
+    a->w = r->w;
+    a->h = r->h;
+    a->cols = kb->w / a->w;
+    if (a->cols == 0)
+        a->cols = 1;
+    if (a->cols > a->count)
+        a->cols = a->count;
+    a->rows = (a->count + a->cols - 1) / a->cols;
+    uint32_t max_rows = (kb->h + r->y) / a->h;
+    if (a->rows > max_rows) {
+        a->rows = max_rows;
+        a->count = a->rows * a->cols;
+    }
+
+    uint32_t width = a->cols * a->w;
+    int32_t x = (int32_t)(r->x + r->w / 2) - (int32_t)(width / 2);
+    if (x + (int32_t)width > (int32_t)kb->w)
+        x = kb->w - width;
+    if (x < 0)
+        x = 0;
+    a->x = x;
+    a->y = kb->h + r->y - a->rows * a->h;
+
+    // start on the cell right above the key
+    a->selected = (r->x + r->w / 2 - a->x) / a->w;
+    if (a->selected >= a->count)
+        a->selected = a->count - 1;
+
+    if (kb->debug)
+        fprintf(stderr, "showing %zu alternates\n", a->count);
+    kbd_clear_last_popup(kb);
+    drw_fill_rectangle(kb->popup_surf, kb->schemes[k->scheme].bg, a->x, a->y,
+                       width, a->rows * a->h, kb->schemes[k->scheme].rounding);
+    for (size_t i = 0; i < a->count; i++)
+        kbd_draw_alternate(kb, i);
+}
+
+static void
+kbd_swipe_start(struct kbd *kb)
+{
+    struct layout *l = kb->layout;
+
+    kbd_disarm_long_press(kb);
+    swipe_begin(l->keyheight);
+    for (size_t i = 0; i < l->keycount; i++) {
+        const struct key_rect *r = &l->rects[i];
+        uint32_t cp = kbd_swipe_letter(kb, &l->keys[i]);
+        if (cp && r->w && r->h)
+            swipe_add_key(cp, r->x + r->w / 2.0, r->y + r->h / 2.0);
+    }
+    swipe_add_point(kb->pending_x, kb->pending_y);
+
+    kb->swiping = true;
+    kbd_clear_last_popup(kb);
+    kbd_draw_key(kb, kb->pending_key, Swipe);
+    kb->last_swipe = kb->pending_key;
+}
+
+static void
+kbd_swipe_motion(struct kbd *kb, uint32_t x, uint32_t y)
+{
+    const struct key *k;
+
+    swipe_add_point((int32_t)x, (int32_t)y);
+    k = kbd_get_key(kb, x, y);
+    if (k && k != kb->last_swipe) {
+        kbd_draw_key(kb, k, Swipe);
+        kb->last_swipe = k;
+    }
+}
+
+static void
+kbd_swipe_cancel(struct kbd *kb)
+{
+    kb->swiping = false;
+    kb->pending_key = NULL;
+    kb->last_swipe = NULL;
+    kbd_draw_layout(kb);
+}
+
+/* The prediction strip, split in KBD_PREDICTIONS cells */
+static void
+kbd_draw_predictions(struct kbd *kb)
+{
+    struct clr_scheme *scheme = &kb->schemes[1];
+    uint32_t w = kb->w / KBD_PREDICTIONS;
+    uint32_t border = kb->layoutset->key_border;
+
+    if (!kb->prediction_h)
+        return;
+    drw_fill_rectangle(kb->surf, kb->schemes[0].bg, 0, 0, kb->w,
+                       kb->prediction_h, 0);
+    for (size_t i = 0; i < kb->prediction_count; i++) {
+        draw_inset(kb->surf, i * w, 0, w, kb->prediction_h, border,
+                   scheme->fg, scheme->rounding);
+        drw_draw_text(kb->surf, scheme->text, i * w, 0, w, kb->prediction_h,
+                      border, kb->predictions[i].word,
+                      scheme->font_description, NULL);
+    }
+}
+
+static void
+kbd_update_predictions(struct kbd *kb)
+{
+    size_t old_count = kb->prediction_count;
+    uint64_t start = stats_now();
+
+    kb->prediction_count =
+        kb->im_sensitive ? 0
+                         : predict_complete(kb->predictions, KBD_PREDICTIONS);
+    stats_record(StatPredict, stats_now() - start);
+    // while typing a word that isn't in the lexicon, nothing changes
+    if (kb->prediction_count || old_count)
+        kbd_draw_predictions(kb);
+}
+
+/* Follow the current word from the keys typed, for when there is no input
+ * method telling what is around the cursor */
+static void
+kbd_predict_key(struct kbd *kb, const struct key *k)
+{
+    uint32_t cp = 0;
+
+    if (k->type == Copy)
+        cp = (kb->mods & Shift) ? k->code_mod : k->code;
+    else
+        cp = kbd_swipe_letter(kb, k);
+
+    if (k->type == Code && k->code == KEY_BACKSPACE)
+        predict_pop();
+    else if (cp && !(kb->mods & (Ctrl | Alt | Super)))
+        predict_push(cp);
+    else
+        predict_reset();
+    kbd_update_predictions(kb);
+}
+
+void
+kbd_set_surrounding_text(struct kbd *kb, const char *text, uint32_t cursor)
+{
+    if (!kb->predict)
+        return;
+    predict_set_text(text, cursor);
+    kbd_update_predictions(kb);
+}
+
+/* Type a word with the keys of the current layout, and a space after it */
+static void
+kbd_type_word(struct kbd *kb, const char *word, uint32_t time)
+{
+    struct layout *l = kb->layout;
+    uint8_t old_mods = kb->mods;
+    bool first = true;
+
+    zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, kb->group);
+    while (*word) {
+        uint32_t cp;
+        word += utf8_decode(word, &cp);
+        for (size_t i = 0; i < l->keycount; i++) {
+            if (kbd_swipe_letter(kb, &l->keys[i]) != cp)
+                continue;
+            kbd_send_key(kb->vkbd, time, l->keys[i].code,
+                         WL_KEYBOARD_KEY_STATE_PRESSED);
+            kbd_send_key(kb->vkbd, time, l->keys[i].code,
+                         WL_KEYBOARD_KEY_STATE_RELEASED);
+            break;
+        }
+        // a latched shift capitalises the first letter only
+        if (first && (kb->mods & Shift)) {
+            kb->mods ^= Shift;
+            zwp_virtual_keyboard_v1_key_mods(kb->vkbd, time, Shift,
+                                             WL_KEYBOARD_KEY_STATE_RELEASED);
+            zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, kb->group);
+        }
+        first = false;
+    }
+    kbd_send_key(kb->vkbd, time, KEY_SPACE, WL_KEYBOARD_KEY_STATE_PRESSED);
+    kbd_send_key(kb->vkbd, time, KEY_SPACE, WL_KEYBOARD_KEY_STATE_RELEASED);
+    if (old_mods != kb->mods)
+        kbd_draw_mods_changed(kb, old_mods);
+}
+
+static void
+kbd_swipe_end(struct kbd *kb, uint32_t time)
+{
+    struct swipe_candidate candidates[SWIPE_CANDIDATES];
+    uint64_t start = stats_now();
+    size_t n = swipe_decode(candidates, SWIPE_CANDIDATES);
+
+    stats_record(StatSwipeDecode, stats_now() - start);
+    if (kb->debug) {
+        for (size_t i = 0; i < n; i++)
+            fprintf(stderr, "swipe candidate %s (%.2f)\n", candidates[i].word,
+                    candidates[i].score);
+    }
+    kbd_swipe_cancel(kb);
+    if (n) {
+        kbd_type_word(kb, candidates[0].word, time);
+        if (kb->predict) {
+            predict_reset();
+            kbd_update_predictions(kb);
+        }
+    }
+}
+
+/* Complete the current word with the prediction touched, if any. Returns false
+ * if x, y is not on the prediction strip. */
+bool
+kbd_press_prediction(struct kbd *kb, uint32_t x, uint32_t y, uint32_t time)
+{
+    if (y >= kb->prediction_h)
+        return false;
+
+    size_t i = x / (kb->w / KBD_PREDICTIONS);
+    if (i >= kb->prediction_count)
+        return true;
+    stats_press();
+
+    const struct prediction *p = &kb->predictions[i];
+    if (kb->im && kb->im_active) {
+        char text[sizeof(p->word) + 1];
+        snprintf(text, sizeof(text), "%s ", p->word + p->typed);
+        zwp_input_method_v2_commit_string(kb->im, text);
+        zwp_input_method_v2_commit(kb->im, kb->im_serial);
+    } else {
+        kbd_type_word(kb, p->word + p->typed, time);
+    }
+    if (kb->debug)
+        fprintf(stderr, "completed %s\n", p->word);
+    predict_reset();
+    kbd_update_predictions(kb);
+    return true;
+}
+
+static void kbd_emit_key(struct kbd *kb, const struct key *k, uint32_t time);
+
+/* With an active input method, Copy keys are committed as text rather than
+ * typed through a keymap made for them. Their label is committed when it
+ * starts with their code point, so labels of several code points (emoji
+ * sequences) are typed whole. Returns false if there is no input method. */
+static bool
+kbd_commit_copy_key(struct kbd *kb, const struct key *k)
+{
+    const struct key_meta *m = kbd_key_meta(kb, k);
+    uint32_t code = (kb->mods & Shift) ? k->code_mod : k->code;
+    const char *label = m ? m->label[kbd_label_state(kb->mods)] : "";
+    char text[5];
+    uint32_t cp;
+
+    if (!kb->im || !kb->im_active)
+        return false;
+    if (*label && (utf8_decode(label, &cp), cp == code)) {
+        zwp_input_method_v2_commit_string(kb->im, label);
+    } else {
+        text[utf8_encode(text, code)] = '\0';
+        zwp_input_method_v2_commit_string(kb->im, text);
+    }
+    zwp_input_method_v2_commit(kb->im, kb->im_serial);
+    return true;
 }
 
 void
 kbd_unpress_key(struct kbd *kb, uint32_t time)
 {
     bool unlatch_shift, unlatch_ctrl, unlatch_alt, unlatch_super, unlatch_altgr, unlatch_tab;
+    uint8_t old_mods = kb->mods;
     unlatch_shift = unlatch_ctrl = unlatch_alt = unlatch_super = unlatch_altgr = unlatch_tab = false;
+    if (kb->alternates.count) {
+        // touched elsewhere while choosing, nothing is typed
+        kbd_hide_alternates(kb);
+    } else if (kb->swiping) {
+        // touched elsewhere while swiping, nothing is typed
+        kbd_swipe_cancel(kb);
+    } else if (kb->pending_key) {
+        // not a long press or a swipe, it is a normal press after all
+        const struct key *k = kb->pending_key;
+        kb->pending_key = NULL;
+        kbd_disarm_long_press(kb);
+        kbd_emit_key(kb, k, kb->pending_time);
+    }
+    kbd_disarm_repeat(kb);
     if (kb->last_press) {
         unlatch_shift = (kb->mods & Shift) == Shift;
         unlatch_ctrl = (kb->mods & Ctrl) == Ctrl;
@@ -305,8 +1047,10 @@ kbd_unpress_key(struct kbd *kb, uint32_t time)
 
         if (kb->last_press->type == Copy) {
             if (kb->debug) fprintf(stderr, "release copy key (unlatch_shift=%d, mods=%d)\n", unlatch_shift, kb->mods);
-            zwp_virtual_keyboard_v1_key(kb->vkbd, time, 127, // COMP key
-                                        WL_KEYBOARD_KEY_STATE_RELEASED);
+            // committed text has no key to release
+            if (!kb->last_press_committed)
+                kbd_send_key(kb->vkbd, time, 127, // COMP key
+                                            WL_KEYBOARD_KEY_STATE_RELEASED);
         } else {
             if (kb->debug) fprintf(stderr, "release key %d", kb->last_press->code);
             if ((kb->shift_space_is_tab) && (kb->last_press->code == KEY_SPACE) && (unlatch_shift)) {
@@ -314,10 +1058,10 @@ kbd_unpress_key(struct kbd *kb, uint32_t time)
                 unlatch_shift = false;
                 unlatch_tab = true;
                 kb->mods ^= Shift;
-                zwp_virtual_keyboard_v1_key(kb->vkbd, time, KEY_TAB,
+                kbd_send_key(kb->vkbd, time, KEY_TAB,
                                             WL_KEYBOARD_KEY_STATE_RELEASED);
             } else {
-                zwp_virtual_keyboard_v1_key(kb->vkbd, time,
+                kbd_send_key(kb->vkbd, time,
                                             kb->last_press->code,
                                             WL_KEYBOARD_KEY_STATE_RELEASED);
             }
@@ -346,14 +1090,15 @@ kbd_unpress_key(struct kbd *kb, uint32_t time)
         }
 
         if (unlatch_shift||unlatch_ctrl||unlatch_alt||unlatch_super||unlatch_altgr||unlatch_tab) {
-            zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, 0);
+            zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, kb->group);
         }
 
         if (kb->compose >= 2) {
             kb->compose = 0;
             kbd_switch_layout(kb, kb->last_abc_layout, kb->last_abc_index);
         } else if (unlatch_shift||unlatch_ctrl||unlatch_alt||unlatch_super||unlatch_altgr||unlatch_tab) {
-            kbd_draw_layout(kb);
+            kbd_draw_key(kb, kb->last_press, Unpress);
+            kbd_draw_mods_changed(kb, old_mods);
         } else {
             kbd_draw_key(kb, kb->last_press, Unpress);
         }
@@ -365,11 +1110,23 @@ kbd_unpress_key(struct kbd *kb, uint32_t time)
 void
 kbd_release_key(struct kbd *kb, uint32_t time)
 {
+    if (kb->swiping) {
+        kbd_swipe_end(kb, time);
+    } else if (kb->alternates.count) {
+        const struct key *k = kb->alternates.keys[kb->alternates.selected];
+        kbd_hide_alternates(kb);
+        kbd_emit_key(kb, k, time);
+    }
     kbd_unpress_key(kb, time);
     if (kb->print_intersect && kb->last_swipe) {
-        printf("\n");
-        // Important so autocompleted words get typed in time
-        fflush(stdout);
+        // written right away, so autocompleted words get typed in time
+        struct stream_record rec = {
+            .time = time,
+            .type = StreamSwipeEnd,
+            .touch_x = kb->touch_x,
+            .touch_y = kb->touch_y,
+        };
+        stream_event(&rec, "", "\n");
         kbd_draw_layout(kb);
         kb->last_swipe = NULL;
     }
@@ -380,6 +1137,26 @@ kbd_release_key(struct kbd *kb, uint32_t time)
 void
 kbd_motion_key(struct kbd *kb, uint32_t time, uint32_t x, uint32_t y)
 {
+    if (kb->alternates.count) {
+        kbd_select_alternate(kb, x, y);
+        return;
+    }
+    if (kb->swiping) {
+        kbd_swipe_motion(kb, x, y);
+        return;
+    }
+    if (kb->pending_key) {
+        // small movements within a held key don't release it
+        const struct key *k = kbd_get_key(kb, x, y);
+        if (k == kb->pending_key)
+            return;
+        if (kbd_swipeable(kb, kb->pending_key)) {
+            kbd_swipe_start(kb);
+            kbd_swipe_motion(kb, x, y);
+            return;
+        }
+    }
+
     // Output intersecting keys
     // (for external 'swiping'-based accelerators).
     if (kb->print_intersect) {
@@ -388,11 +1165,11 @@ kbd_motion_key(struct kbd *kb, uint32_t time, uint32_t x, uint32_t y)
             // Redraw last press as a swipe.
             kbd_draw_key(kb, kb->last_swipe, Swipe);
         }
-        struct key *intersect_key;
+        const struct key *intersect_key;
         intersect_key = kbd_get_key(kb, x, y);
         if (intersect_key && (!kb->last_swipe ||
                               intersect_key->label != kb->last_swipe->label)) {
-            kbd_print_key_stdout(kb, intersect_key);
+            kbd_output_key(kb, intersect_key, StreamSwipe, time);
             kb->last_swipe = intersect_key;
             kbd_draw_key(kb, kb->last_swipe, Swipe);
         }
@@ -404,15 +1181,16 @@ kbd_motion_key(struct kbd *kb, uint32_t time, uint32_t x, uint32_t y)
 }
 
 void
-kbd_press_key(struct kbd *kb, struct key *k, uint32_t time)
+kbd_press_key(struct kbd *kb, const struct key *k, uint32_t time)
 {
+    stats_press();
     if ((kb->compose == 1) && (k->type != Compose) && (k->type != Mod)) {
         if ((k->type == NextLayer) || (k->type == BackLayer) ||
             ((k->type == Code) && (k->code == KEY_SPACE))) {
             kb->compose = 0;
             if (kb->debug)
                 fprintf(stderr, "showing layout index\n");
-            kbd_switch_layout(kb, &kb->layouts[Index], 0);
+            kbd_switch_layout(kb, &kb->layouts[kb->layoutset->index], 0);
             return;
         } else if (k->layout) {
             kb->compose++;
@@ -426,34 +1204,50 @@ kbd_press_key(struct kbd *kb, struct key *k, uint32_t time)
         }
     }
 
+    if (kbd_has_alternates(kb, k) || kbd_swipeable(kb, k)) {
+        kbd_hold_key(kb, k, time);
+        return;
+    }
+    kbd_emit_key(kb, k, time);
+}
+
+static void
+kbd_emit_key(struct kbd *kb, const struct key *k, uint32_t time)
+{
+    uint8_t old_mods;
+
     switch (k->type) {
     case Code:
         if (k->code_mod) {
             zwp_virtual_keyboard_v1_key_mods(kb->vkbd, time, k->code_mod, WL_KEYBOARD_KEY_STATE_PRESSED);
             if (k->reset_mod) {
                 zwp_virtual_keyboard_v1_modifiers(kb->vkbd, k->code_mod, 0, 0,
-                                                  0);
+                                                  kb->group);
             } else {
                 zwp_virtual_keyboard_v1_modifiers(
-                    kb->vkbd, kb->mods ^ k->code_mod, 0, 0, 0);
+                    kb->vkbd, kb->mods ^ k->code_mod, 0, 0, kb->group);
             }
         } else {
-            zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, 0);
+            zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, kb->group);
         }
         kb->last_swipe = kb->last_press = k;
         kbd_draw_key(kb, k, Press);
         if ((kb->shift_space_is_tab) && (k->code == KEY_SPACE) && (kb->mods & Shift)) {
             // shift space is tab
             zwp_virtual_keyboard_v1_key_mods(kb->vkbd, time, Shift, WL_KEYBOARD_KEY_STATE_RELEASED);
-            zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods ^ Shift, 0, 0, 0);
-            zwp_virtual_keyboard_v1_key(kb->vkbd, time, KEY_TAB,
+            zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods ^ Shift, 0, 0, kb->group);
+            kbd_send_key(kb->vkbd, time, KEY_TAB,
                                         WL_KEYBOARD_KEY_STATE_PRESSED);
+            kbd_arm_repeat(kb, KEY_TAB, time);
         } else {
-            zwp_virtual_keyboard_v1_key(kb->vkbd, time, kb->last_press->code,
+            kbd_send_key(kb->vkbd, time, kb->last_press->code,
                                         WL_KEYBOARD_KEY_STATE_PRESSED);
+            kbd_arm_repeat(kb, kb->last_press->code, time);
         }
         if (kb->print || kb->print_intersect)
-            kbd_print_key_stdout(kb, k);
+            kbd_output_key(kb, k, StreamPress, time);
+        if (kb->predict)
+            kbd_predict_key(kb, k);
         if (kb->compose) {
             if (kb->debug)
                 fprintf(stderr, "pressing composed key\n");
@@ -461,6 +1255,7 @@ kbd_press_key(struct kbd *kb, struct key *k, uint32_t time)
         }
         break;
     case Mod:
+        old_mods = kb->mods;
         kb->mods ^= k->code;
         if (kb->mods & k->code) {
             if (kb->debug)
@@ -472,7 +1267,7 @@ kbd_press_key(struct kbd *kb, struct key *k, uint32_t time)
             zwp_virtual_keyboard_v1_key_mods(kb->vkbd, time, k->code, WL_KEYBOARD_KEY_STATE_RELEASED);
         }
         if ((k->code == Shift) || (k->code == CapsLock)) {
-            kbd_draw_layout(kb);
+            kbd_draw_mods_changed(kb, old_mods);
         } else {
             if (kb->mods & k->code) {
                 kbd_draw_key(kb, k, Press);
@@ -480,7 +1275,7 @@ kbd_press_key(struct kbd *kb, struct key *k, uint32_t time)
                 kbd_draw_key(kb, k, Unpress);
             }
         }
-        zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, 0);
+        zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, kb->group);
         break;
     case Layout:
         // switch to the layout determined by the key
@@ -527,10 +1322,14 @@ kbd_press_key(struct kbd *kb, struct key *k, uint32_t time)
         }
         break;
     case Copy:
-        // copy code as unicode chr by setting a temporary keymap
         kb->last_swipe = kb->last_press = k;
         kbd_draw_key(kb, k, Press);
-        if (kb->mods & Shift) {
+        kb->last_press_committed = kbd_commit_copy_key(kb, k);
+        if (kb->last_press_committed) {
+            if (kb->debug)
+                fprintf(stderr, "Committing copy key\n");
+        } else if (kb->mods & Shift) {
+            // copy code as unicode chr by setting a temporary keymap
             if (kb->debug)
                     fprintf(stderr, "Pressing copy key (with shift)\n");
             create_and_upload_keymap(kb, kb->layout->keymap_name, k->code_mod);
@@ -539,19 +1338,46 @@ kbd_press_key(struct kbd *kb, struct key *k, uint32_t time)
                     fprintf(stderr, "Pressing copy key\n");
             create_and_upload_keymap(kb, kb->layout->keymap_name, k->code);
         }
-        zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, 0);
-        zwp_virtual_keyboard_v1_key(kb->vkbd, time, 127, // COMP key
-                                    WL_KEYBOARD_KEY_STATE_PRESSED);
+        if (!kb->last_press_committed) {
+            zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, kb->group);
+            kbd_send_key(kb->vkbd, time, 127, // COMP key
+                                        WL_KEYBOARD_KEY_STATE_PRESSED);
+        }
         if (kb->print || kb->print_intersect)
-            kbd_print_key_stdout(kb, k);
+            kbd_output_key(kb, k, StreamPress, time);
+        if (kb->predict)
+            kbd_predict_key(kb, k);
         break;
     default:
         break;
     }
 }
 
+/* Length in bytes of the first UTF-8 character of a string */
+static size_t
+kbd_first_utf8_char_len(const char *str)
+{
+    unsigned char c = (unsigned char)str[0];
+    size_t len;
+
+    if ((c & 0x80) == 0) {
+        len = 1;
+    } else if ((c & 0xE0) == 0xC0) {
+        len = 2;
+    } else if ((c & 0xF0) == 0xE0) {
+        len = 3;
+    } else if ((c & 0xF8) == 0xF0) {
+        len = 4;
+    } else {
+        len = 1; // Invalid UTF-8
+    }
+
+    return strnlen(str, len);
+}
+
 void
-kbd_print_key_stdout(struct kbd *kb, struct key *k)
+kbd_output_key(struct kbd *kb, const struct key *k, enum stream_event type,
+               uint32_t time)
 {
     /* Printed keys may slightly differ from the actual output
      * we generally print what is on the key LABEL and only support the normal
@@ -562,20 +1388,21 @@ kbd_print_key_stdout(struct kbd *kb, struct key *k)
      * from a single keypress.
      * */
 
+    char text[5] = "";
     bool handled = true;
     if (k->type == Code) {
         switch (k->code) {
         case KEY_SPACE:
-            printf(" ");
+            strcpy(text, " ");
             break;
         case KEY_ENTER:
-            printf("\n");
+            strcpy(text, "\n");
             break;
         case KEY_BACKSPACE:
-            printf("\b");
+            strcpy(text, "\b");
             break;
         case KEY_TAB:
-            printf("\t");
+            strcpy(text, "\t");
             break;
         default:
             handled = false;
@@ -585,35 +1412,36 @@ kbd_print_key_stdout(struct kbd *kb, struct key *k)
         return;
     }
 
-    if (!handled) {
-        if ((kb->mods & Shift) || 
-            ((kb->mods & CapsLock) & (strlen(k->label) == 1 && isalpha(k->label[0]))))
-            kbd_print_first_utf8_char_stdout(k->shift_label);
+    const struct key_meta *m = kbd_key_meta(kb, k);
+    enum key_label_state state = kbd_label_state(kb->mods);
+    const char *label = m ? m->label[state] : "";
+    if (!handled && m) {
+        const char *printed = NULL;
+        if (state == LabelShift || (state == LabelCaps && m->alpha))
+            printed = m->label[state];
         else if (!(kb->mods & Ctrl) && !(kb->mods & Alt) && !(kb->mods & Super))
-            kbd_print_first_utf8_char_stdout(k->label);
+            printed = m->label[LabelPlain];
+        if (printed)
+            memcpy(text, printed, kbd_first_utf8_char_len(printed));
     }
-    fflush(stdout);
-}
 
-void kbd_print_first_utf8_char_stdout(const char *str) {
-    unsigned char c = (unsigned char)str[0];
-    int len;
-
-    if ((c & 0x80) == 0) {
-        len = 1;
-    } else if ((c & 0xE0) == 0xC0) {
-        len = 2;
-    } else if ((c & 0xF0) == 0xE0) {
-        len = 3;
-    } else if ((c & 0xF8) == 0xF0) {
-        len = 4;
-    } else {
-        len = 1; // Invalid UTF-8
-    }
-
-    for (int i = 0; i < len && str[i] != '\0'; i++) {
-        putchar(str[i]);
+    // structured formats also get the key's label, geometry and touch point
+    const struct key_rect *r = kbd_key_rect(kb, k);
+    struct stream_record rec = {
+        .time = time,
+        .type = type,
+        .mods = kb->mods,
+        .code = (k->type == Copy && (kb->mods & Shift)) ? k->code_mod : k->code,
+        .touch_x = kb->touch_x,
+        .touch_y = kb->touch_y,
+    };
+    if (r) {
+        rec.x = r->x;
+        rec.y = r->y;
+        rec.w = r->w;
+        rec.h = r->h;
     }
+    stream_event(&rec, label, text);
 }
 
 void
@@ -626,63 +1454,140 @@ kbd_clear_last_popup(struct kbd *kb)
     }
 }
 
+/* Size the highlight buffers for a key of any width in the current layout;
+ * they only grow, unless the scale changes */
+static void
+kbd_prepare_highlight(struct kbd *kb)
+{
+    struct drwsurf *ds = kb->highlight_surf;
+    uint32_t h = kb->layout->keyheight;
+
+    if (ds->scale == kb->scale) {
+        if (ds->width >= ceil(kb->w * kb->scale) &&
+            ds->height >= ceil(h * kb->scale))
+            return;
+        // keep room for the taller keys of layouts with fewer rows
+        if (ds->height / ds->scale > h)
+            h = ds->height / ds->scale;
+    }
+    drwsurf_resize(ds, kb->w, h, kb->scale);
+    if (kb->highlight_viewport)
+        wp_viewport_set_destination(kb->highlight_viewport, kb->w, h);
+    else
+        wl_surface_set_buffer_scale(ds->surf, kb->scale);
+    kb->highlight_w = kb->w; // new buffers are cleared all over
+}
+
+static void
+kbd_show_highlight(struct kbd *kb, const struct key *k,
+                   const struct key_rect *r, const char *label, int *extents)
+{
+    struct clr_scheme *scheme = &kb->schemes[k->scheme];
+    struct drwsurf *ds = kb->highlight_surf;
+    uint32_t border = kb->layoutset->key_border;
+
+    kbd_prepare_highlight(kb);
+    // only what the previous key covered needs clearing
+    if (kb->highlight_w)
+        drw_do_clear(ds, 0, 0, kb->highlight_w, r->h);
+    draw_inset(ds, 0, 0, r->w, r->h, border, scheme->high,
+               scheme->rounding);
+    drw_draw_text(ds, scheme->text_press, 0, 0, r->w, r->h, border,
+                  label, scheme->font_description, extents);
+    kb->highlight_w = r->w;
+    kb->highlighted = k;
+
+    // the position applies with the next commit of the keyboard surface
+    wl_subsurface_set_position(kb->highlight_sub, r->x, r->y);
+    drwsurf_flush(ds);
+    wl_surface_commit(kb->surf->surf);
+}
+
+static void
+kbd_hide_highlight(struct kbd *kb)
+{
+    if (!kb->highlighted)
+        return;
+    drwsurf_detach(kb->highlight_surf);
+    kb->highlighted = NULL;
+}
+
 void
-kbd_draw_key(struct kbd *kb, struct key *k, enum key_draw_type type)
+kbd_draw_key(struct kbd *kb, const struct key *k, enum key_draw_type type)
 {
-    const char *label = ((kb->mods & Shift)||((kb->mods & CapsLock) && 
-        strlen(k->label) == 1 && isalpha(k->label[0]))) ? k->shift_label : k->label;
+    const struct key_rect *r = kbd_key_rect(kb, k);
+    struct key_meta *m = kbd_key_meta(kb, k);
+    if (!r || !m)
+        return;
+    if (!drawing_layout)
+        stats_count(StatKeyRedraws, 1);
+    enum key_label_state state = kbd_label_state(kb->mods);
+    const char *label = m->label[state];
+    int *extents = m->extents[state];
     if (kb->debug)
-        fprintf(stderr, "Draw key +%d+%d %dx%d -> %s\n", k->x, k->y, k->w, k->h,
+        fprintf(stderr, "Draw key +%d+%d %dx%d -> %s\n", r->x, r->y, r->w, r->h,
                 label);
     struct clr_scheme *scheme = &kb->schemes[k->scheme];
+    uint32_t border = kb->layoutset->key_border;
+    // the keyboard surface keeps showing the key unpressed meanwhile
+    bool overlay = kb->highlight_sub && kb->show_highlight &&
+                   (k->type == Code || k->type == Copy);
 
     switch (type) {
     case None:
     case Unpress:
-        draw_inset(kb->surf, k->x, k->y, k->w, k->h, KBD_KEY_BORDER,
+        if (overlay && type == Unpress && kb->highlighted == k) {
+            kbd_hide_highlight(kb);
+            break;
+        }
+        draw_inset(kb->surf, r->x, r->y, r->w, r->h, border,
                    scheme->fg, scheme->rounding);
-        drw_draw_text(kb->surf, scheme->text, k->x, k->y, k->w, k->h,
-                  KBD_KEY_BORDER, label, scheme->font_description);
+        drw_draw_text(kb->surf, scheme->text, r->x, r->y, r->w, r->h,
+                  border, label, scheme->font_description, extents);
         break;
     case Press:
-        draw_inset(kb->surf, k->x, k->y, k->w, k->h, KBD_KEY_BORDER,
+        if (overlay) {
+            kbd_show_highlight(kb, k, r, label, extents);
+            break;
+        }
+        draw_inset(kb->surf, r->x, r->y, r->w, r->h, border,
                    kb->show_highlight ? scheme->high : scheme->fg,
                    scheme->rounding);
         drw_draw_text(kb->surf,
                   kb->show_highlight ? scheme->text_press : scheme->text,
-                  k->x, k->y, k->w, k->h, KBD_KEY_BORDER, label,
-                  scheme->font_description);
+                  r->x, r->y, r->w, r->h, border, label,
+                  scheme->font_description, extents);
         break;
     case Swipe:
-        draw_over_inset(kb->surf, k->x, k->y, k->w, k->h, KBD_KEY_BORDER,
+        draw_over_inset(kb->surf, r->x, r->y, r->w, r->h, border,
                         scheme->swipe, scheme->rounding);
-        drw_draw_text(kb->surf, scheme->text_swipe, k->x, k->y, k->w, k->h,
-                  KBD_KEY_BORDER, label, scheme->font_description);
+        drw_draw_text(kb->surf, scheme->text_swipe, r->x, r->y, r->w, r->h,
+                  border, label, scheme->font_description, extents);
         break;
     default:
-        drw_draw_text(kb->surf, scheme->text, k->x, k->y, k->w, k->h,
-                  KBD_KEY_BORDER, label, scheme->font_description);
+        drw_draw_text(kb->surf, scheme->text, r->x, r->y, r->w, r->h,
+                  border, label, scheme->font_description, extents);
     }
 
 
     if (kb->show_popup && (type == Press || type == Unpress)) {
         kbd_clear_last_popup(kb);
 
-        kb->last_popup_x = k->x;
-        kb->last_popup_y = kb->h + k->y - k->h;
-        kb->last_popup_w = k->w;
-        kb->last_popup_h = k->h;
+        kb->last_popup_x = r->x;
+        kb->last_popup_y = kb->h + r->y - r->h;
+        kb->last_popup_w = r->w;
+        kb->last_popup_h = r->h;
 
-        drw_fill_rectangle(kb->popup_surf, scheme->bg, k->x,
-                           kb->last_popup_y, k->w, k->h, scheme->rounding);
-        draw_inset(kb->popup_surf, k->x, kb->last_popup_y, k->w, k->h,
-                   KBD_KEY_BORDER,
+        drw_fill_rectangle(kb->popup_surf, scheme->bg, r->x,
+                           kb->last_popup_y, r->w, r->h, scheme->rounding);
+        draw_inset(kb->popup_surf, r->x, kb->last_popup_y, r->w, r->h,
+                   border,
                    kb->show_highlight ? scheme->high : scheme->fg,
                    scheme->rounding);
         drw_draw_text(kb->popup_surf,
                       kb->show_highlight ? scheme->text_press : scheme->text,
-                      k->x, kb->last_popup_y, k->w, k->h, KBD_KEY_BORDER, label,
-                      scheme->font_description);
+                      r->x, kb->last_popup_y, r->w, r->h, border, label,
+                      scheme->font_description, extents);
     }
 }
 
@@ -690,11 +1595,17 @@ void
 kbd_draw_layout(struct kbd *kb)
 {
     struct drwsurf *d = kb->surf;
-    struct key *next_key = kb->layout->keys;
+    const struct key *next_key = kb->layout->keys;
+    uint64_t start = stats_now();
     if (kb->debug)
         fprintf(stderr, "Draw layout\n");
 
+    kbd_prepare_layout(kb, kb->layout);
+    kbd_hide_highlight(kb);
+    drawing_layout = true;
+
     drw_fill_rectangle(d, kb->schemes[0].bg, 0, 0, kb->w, kb->h, 0);
+    kbd_draw_predictions(kb);
 
     while (next_key->type != Last) {
         if ((next_key->type == Pad) || (next_key->type == EndRow)) {
@@ -709,27 +1620,40 @@ kbd_draw_layout(struct kbd *kb)
         }
         next_key++;
     }
+
+    drawing_layout = false;
+    stats_count(StatLayoutRedraws, 1);
+    stats_record(StatDrawLayout, stats_now() - start);
 }
 
 void
-kbd_resize(struct kbd *kb, struct layout *layouts, uint8_t layoutcount)
+kbd_resize(struct kbd *kb)
 {
-    fprintf(stderr, "Resize %dx%d %f, %d layouts\n", kb->w, kb->h, kb->scale,
-            layoutcount);
+    fprintf(stderr, "Resize %dx%d %f, %ld layouts\n", kb->w, kb->h, kb->scale,
+            kb->layoutset->layoutcount);
 
     drwsurf_resize(kb->surf, kb->w, kb->h, kb->scale);
     drwsurf_resize(kb->popup_surf, kb->w, kb->h * 2, kb->scale);
-    for (int i = 0; i < layoutcount; i++) {
-        if (kb->debug) {
-            if (layouts[i].name)
-                fprintf(stderr, "Initialising layout %s, keymap %s\n",
-                        layouts[i].name, layouts[i].keymap_name);
-            else
-                fprintf(stderr, "Initialising unnamed layout %d, keymap %s\n",
-                        i, layouts[i].keymap_name);
-        }
-        kbd_init_layout(&layouts[i], kb->w, kb->h);
-    }
+
+    // about a row of keys, taken from the height of the layouts
+    kb->prediction_h = kb->predict ? kb->h / 6 : 0;
+    // layouts are laid out again when they are next shown
+    kb->generation++;
+    kbd_draw_layout(kb);
+}
+
+/* Only the scale changed: key geometry and text extents are in surface
+ * coordinates and stay, the buffers are reallocated and painted again. Nothing
+ * is shown until the caller attaches them. */
+void
+kbd_rescale(struct kbd *kb)
+{
+    if (kb->debug)
+        fprintf(stderr, "Rescale to %f\n", kb->scale);
+
+    drwsurf_resize(kb->surf, kb->w, kb->h, kb->scale);
+    drwsurf_resize(kb->popup_surf, kb->w, kb->h * 2, kb->scale);
+    kb->last_popup_w = kb->last_popup_h = 0;
     kbd_draw_layout(kb);
 }
 
@@ -748,12 +1672,43 @@ draw_over_inset(struct drwsurf *ds, uint32_t x, uint32_t y, uint32_t width,
                        height - (border * 2), rounding);
 }
 
-void
-create_and_upload_keymap(struct kbd *kb, const char *name, uint32_t comp_unichr)
+/* The keymap template at index, the compiled-in ones are unpacked the first
+ * time they are needed and kept */
+const char *
+kbd_keymap(struct layoutset *ls, size_t index)
 {
+    if (!ls->keymaps[index]) {
+        ls->keymaps[index] = keymappack_unpack(ls->pack, index);
+        if (!ls->keymaps[index]) {
+            die("could not unpack keymap %s\n", ls->keymap_names[index]);
+        }
+    }
+    return ls->keymaps[index];
+}
+
+static const char *
+kbd_combined_keymap(struct layoutset *ls, size_t index)
+{
+    if (!ls->combined[index]) {
+        ls->combined[index] =
+            keymappack_unpack(ls->pack, ls->keymapcount + index);
+        if (!ls->combined[index]) {
+            die("could not unpack combined keymap %zu\n", index);
+        }
+    }
+    return ls->combined[index];
+}
+
+/* The keymap template to upload for the named keymap: a combined keymap that
+ * has it as a group, preferably the one uploaded, or else the keymap itself.
+ * Sets kb->combined and kb->group accordingly. */
+static const char *
+kbd_find_keymap(struct kbd *kb, const char *name)
+{
+    struct layoutset *ls = kb->layoutset;
     int keymap_index = -1;
-    for (int i = 0; i < NUMKEYMAPS; i++) {
-        if (!strcmp(keymap_names[i], name)) {
+    for (int i = 0; i < ls->keymapcount; i++) {
+        if (!strcmp(ls->keymap_names[i], name)) {
             keymap_index = i;
         }
     }
@@ -761,7 +1716,30 @@ create_and_upload_keymap(struct kbd *kb, const char *name, uint32_t comp_unichr)
         fprintf(stderr, "No such keymap defined: %s\n", name);
         exit(9);
     }
-    const char *keymap_template = keymaps[keymap_index];
+
+    int combined = -1, group = 0;
+    for (int c = 0; c < ls->combinedcount; c++) {
+        for (int g = 0; g < KBD_MAX_GROUPS; g++) {
+            if (ls->combined_groups[c][g] == keymap_index &&
+                (combined == -1 || c == kb->combined)) {
+                combined = c;
+                group = g;
+            }
+        }
+    }
+    kb->combined = combined;
+    kb->group = group;
+    if (combined == -1)
+        return kbd_keymap(ls, keymap_index);
+    return kbd_combined_keymap(ls, combined);
+}
+
+/* Write a keymap to a new anonymous file, returns its fd */
+int
+kbd_prepare_keymap(struct kbd *kb, const char *name, uint32_t comp_unichr,
+                   uint32_t *size)
+{
+    const char *keymap_template = kbd_find_keymap(kb, name);
     size_t keymap_size = strlen(keymap_template) + 64;
     char *keymap_str = malloc(keymap_size);
     sprintf(keymap_str, keymap_template, comp_unichr, comp_unichr);
@@ -775,11 +1753,34 @@ create_and_upload_keymap(struct kbd *kb, const char *name, uint32_t comp_unichr)
     if (ptr == (void *)-1) {
         die("could not map keymap data\n");
     }
+    memcpy(ptr, keymap_str, keymap_size);
+    munmap(ptr, keymap_size);
+    free((void *)keymap_str);
+    *size = keymap_size;
+    return keymap_fd;
+}
+
+/* Send a keymap prepared by kbd_prepare_keymap and close its fd */
+void
+kbd_upload_keymap(struct kbd *kb, int fd, uint32_t size)
+{
     if (kb->vkbd == NULL) {
         die("kb.vkbd = NULL\n");
     }
-    strcpy(ptr, keymap_str);
     zwp_virtual_keyboard_v1_keymap(kb->vkbd, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1,
-                                   keymap_fd, keymap_size);
-    free((void *)keymap_str);
+                                   fd, size);
+    close(fd);
+    // a new keymap starts out in group 1
+    if (kb->group)
+        zwp_virtual_keyboard_v1_modifiers(kb->vkbd, kb->mods, 0, 0, kb->group);
+    stats_count(StatKeymapUploads, 1);
+    stats_count(StatKeymapBytes, size);
+}
+
+void
+create_and_upload_keymap(struct kbd *kb, const char *name, uint32_t comp_unichr)
+{
+    uint32_t size;
+    int fd = kbd_prepare_keymap(kb, name, comp_unichr, &size);
+    kbd_upload_keymap(kb, fd, size);
 }
@@ -2,8 +2,13 @@
 #define __KEYBOARD_H
 
 #include "drw.h"
+#include "predict.h"
+#include "stream.h"
 
 #define MAX_LAYERS 25
+#define KBD_MAX_ALTERNATES 40
+#define KBD_PREDICTIONS 3 // completions shown above the keys
+#define KBD_MAX_GROUPS 4  // XKB groups of a keymap
 
 enum key_type;
 enum key_modifier_type;
@@ -11,6 +16,10 @@ struct clr_scheme;
 struct key;
 struct layout;
 struct kbd;
+struct zwp_input_method_v2;
+struct wl_subsurface;
+struct keymappack;
+struct wp_viewport;
 
 enum key_type {
 	Pad = 0, // Padding, not a pressable key
@@ -41,6 +50,26 @@ enum key_modifier_type {
 	AltGr = 128,
 };
 
+/* Content purposes of text fields, as defined by text-input-unstable-v3 and
+ * passed on by the input method */
+enum content_purpose {
+	ContentPurposeNormal = 0,
+	ContentPurposeAlpha,
+	ContentPurposeDigits,
+	ContentPurposeNumber,
+	ContentPurposePhone,
+	ContentPurposeUrl,
+	ContentPurposeEmail,
+	ContentPurposeName,
+	ContentPurposePassword,
+	ContentPurposePin,
+	ContentPurposeDate,
+	ContentPurposeTime,
+	ContentPurposeDatetime,
+	ContentPurposeTerminal,
+	NumContentPurposes,
+};
+
 enum key_draw_type {
 	None = 0,
 	Unpress,
@@ -77,18 +106,112 @@ struct key {
 	const uint32_t code_mod; /* modifier to force when this key is pressed */
 	uint8_t scheme;          // index of the scheme to use
 	bool reset_mod;          /* reset modifiers when clicked */
+};
+
+/* Actual coordinates of a key on the surface (pixels), computed by
+ * kbd_init_layout. They are kept out of struct key so the key tables stay
+ * read-only and hit testing and drawing scan a densely packed array. Keys that
+ * are not drawn (Pad, EndRow, Last) have an empty rectangle.
+ */
+struct key_rect {
+	uint16_t x, y, w, h;
+};
 
-	// actual coordinates on the surface (pixels), will be computed automatically
-	// for all keys
-	uint32_t x, y, w, h;
+enum key_label_state {
+	LabelPlain = 0,
+	LabelShift,
+	LabelCaps,
+	NumLabelStates,
+};
+
+/* Label data derived from a key once, when its layout is first prepared, so
+ * drawing and printing never inspect label strings. Text extents depend on the
+ * key geometry and are reset whenever it is recomputed.
+ */
+struct key_meta {
+	const char *label[NumLabelStates]; // label shown in each modifier state
+	uint16_t len[NumLabelStates];      // label length in bytes
+	bool alpha;         // single letter, affected by CapsLock
+	bool shift_changes; // label differs between the plain and Shift states
+	int extents[NumLabelStates][2]; // text width and height, -1 if unknown
 };
 
 struct layout {
-	struct key *keys;
+	const struct key *keys;
 	const char *keymap_name;
 	const char *name;
 	bool abc; //is this an alphabetical/abjad layout or not? (i.e. something that is a primary input layout)
 	uint32_t keyheight; // absolute height (pixels)
+	uint32_t generation; // kbd generation the key geometry was computed for
+	size_t keycount;     // number of keys, including the Last key
+	struct key_rect *rects; // geometry of each key, same order as keys
+	struct key_meta *meta;  // label data of each key, same order as keys
+};
+
+/* A complete set of layouts and the keymaps they refer to. This is either a
+ * layout family compiled in from layout.*.h, keymap.*.h and config.*.h (see
+ * layoutset.c) or one mapped from a layout file (see layoutfile.h).
+ */
+struct layoutset {
+	const char *name; // of a compiled-in family, NULL for a layout file
+	struct layout *layouts;
+	size_t layoutcount; // number of layouts, including the index layout
+	size_t index;       // layout shown by Cmp + space, excluded from layers
+
+	const char *const *keymap_names;
+	// printf templates taking the Copy codepoint twice. The compiled-in ones
+	// are packed and NULL until unpacked by kbd_keymap.
+	const char **keymaps;
+	size_t keymapcount;
+	const struct keymappack *pack; // the compiled-in keymaps, NULL otherwise
+
+	// Keymaps holding up to KBD_MAX_GROUPS of the keymaps above as their XKB
+	// groups, so that switching between those only changes the group.
+	// combined_groups[c][g] is the index of the keymap in group g of
+	// combined keymap c, or -1. Packed like the keymaps, none in layout files.
+	const char **combined;
+	const int16_t (*combined_groups)[KBD_MAX_GROUPS];
+	size_t combinedcount;
+
+	// layer sequences, those given with -l replace the defaults of config.h
+	size_t *layers, *landscape_layers;
+	size_t layercount, landscape_layercount;
+
+	// defaults from the config.h of a compiled-in family, a layout file takes
+	// those of the family it replaces
+	struct clr_scheme *schemes;
+	size_t schemecount;
+	const char *const *content_purpose_layouts; // [NumContentPurposes]
+	uint32_t height, landscape_height;          // pixels
+	uint32_t key_border;                        // spacing around each key
+	uint32_t repeat_delay, repeat_rate;
+	uint32_t long_press_delay;
+	bool shift_space_is_tab;
+};
+
+/* The compiled-in layout families, in the order of LAYOUTS; the first is the
+ * default. A family is only set up, and its data touched, once asked for.
+ */
+struct builtin_layoutset {
+	const char *name;
+	struct layoutset *(*get)(void);
+};
+
+/* Called with a compiled-in family when it is first set up, to give it the
+ * colors and fonts that replace those of its config.h. NULL for none. */
+extern void (*kbd_layoutset_setup)(struct layoutset *ls);
+
+/* The characters of a held key's layout, offered in a grid of key sized cells
+ * drawn on the popup surface above the key. Row 0 is the one nearest the key.
+ */
+struct alternates {
+	const struct key *keys[KBD_MAX_ALTERNATES];
+	struct layout *layout; // layout the keys belong to
+	size_t count;          // 0 if not shown
+	size_t selected;
+	uint32_t x, y;         // top left corner on the popup surface
+	uint32_t cols, rows;
+	uint32_t w, h;         // size of a cell
 };
 
 struct kbd {
@@ -101,7 +224,9 @@ struct kbd {
 
 	bool print;
 	bool print_intersect;
+	int32_t touch_x, touch_y; // last touch or pointer position, for output
 	uint32_t w, h;
+	uint32_t generation; // bumped on resize, invalidates all layout geometry
 	double scale;
 	double preferred_scale, preferred_fractional_scale;
 	bool landscape;
@@ -109,21 +234,65 @@ struct kbd {
 	bool exclusive;
 	uint8_t mods;
 	uint8_t compose;
-	struct key *last_press;
-	struct key *last_swipe;
+	const struct key *last_press;
+	bool last_press_committed; // it was committed as text, not pressed
+	const struct key *last_swipe;
 	struct layout *prevlayout; //the previous layout, needed to keep track of keymap changes
 	size_t layer_index;
 	struct layout *last_abc_layout; //the last alphabetical layout to fall back to (may be further away than prevlayout)
 	size_t last_abc_index; //the layer index of the last alphabetical layout
 
-	struct layout *layouts;
+	struct layoutset *layoutset;
+	struct layout *layouts; // shorthand for layoutset->layouts
 	struct Output *output; //only used to keep track of landscape flipping, never dereferenced
-	enum layout_id *layers;
-	enum layout_id *landscape_layers;
+	size_t *layers;
+	size_t *landscape_layers;
+	size_t layercount, landscape_layercount;
 
 	struct drwsurf *surf;
 	struct drwsurf *popup_surf;
+
+	/* Presses of Code and Copy keys are shown on a subsurface above the key,
+	 * so that typing never redraws the keyboard surface. NULL if there is no
+	 * wl_subcompositor. */
+	struct drwsurf *highlight_surf;
+	struct wl_subsurface *highlight_sub;
+	struct wp_viewport *highlight_viewport; // NULL without fractional scaling
+	const struct key *highlighted; // key shown on it, NULL if unmapped
+	uint32_t highlight_w;          // width drawn on it
 	struct zwp_virtual_keyboard_v1 *vkbd;
+	int keymap_fd; // initial keymap, prepared before the vkbd exists
+	uint32_t keymap_size;
+	int combined;  // combined keymap uploaded, -1 for a single one
+	uint8_t group; // of the current layout's keymap in the uploaded one
+
+	int repeat_fd; // timerfd for key repeat, -1 if not used
+	uint32_t repeat_delay; // ms before a held key starts repeating
+	uint32_t repeat_rate;  // repeats per second, 0 disables repeat
+	uint32_t repeat_code;  // key being held and repeated, 0 if none
+	uint32_t repeat_time;  // event time of its press
+	uint64_t repeat_start; // CLOCK_MONOTONIC ms of its press
+
+	int long_press_fd; // timerfd for long presses, -1 if not used
+	uint32_t long_press_delay; // ms a key must be held to show alternates
+	struct alternates alternates;
+
+	bool swipe_typing; // decode swipes over letters into words
+	bool swiping;      // a swipe is in progress
+
+	const struct key *pending_key; // held key whose press isn't sent yet
+	uint32_t pending_time;         // event time of its press
+	int32_t pending_x, pending_y;  // where it was touched
+
+	bool predict;           // show completions of the current word
+	uint32_t prediction_h;  // height of the strip they are shown in
+	struct prediction predictions[KBD_PREDICTIONS];
+	size_t prediction_count;
+
+	struct zwp_input_method_v2 *im; // NULL without an input method
+	bool im_active;     // a text field has focus, as of the last done
+	bool im_sensitive;  // it holds a password or the like, not to predict
+	uint32_t im_serial; // done events received, for commits
 
 	uint32_t last_popup_x, last_popup_y, last_popup_w, last_popup_h;
 };
@@ -133,30 +302,49 @@ void draw_inset(struct drwsurf *ds, uint32_t x, uint32_t y, uint32_t width,
 void draw_over_inset(struct drwsurf *ds, uint32_t x, uint32_t y, uint32_t width,
                      uint32_t height, uint32_t border, Color color, int rounding);
 
-void kbd_init(struct kbd *kb, struct layout *layouts,
+void kbd_init(struct kbd *kb, struct layoutset *layoutset,
               char *layer_names_list, char *landscape_layer_names_list);
+size_t *kbd_init_layers(struct layoutset *ls, char *layer_names_list,
+                        size_t *count);
 void kbd_init_layout(struct layout *l, uint32_t width, uint32_t height);
-struct key *kbd_get_key(struct kbd *kb, uint32_t x, uint32_t y);
+void kbd_init_layout_tables(struct layout *l);
+void kbd_prepare_layout(struct kbd *kb, struct layout *l);
+const struct key *kbd_get_key(struct kbd *kb, uint32_t x, uint32_t y);
 size_t kbd_get_layer_index(struct kbd *kb, struct layout *l);
+void kbd_repeat(struct kbd *kb);
+void kbd_long_press(struct kbd *kb);
 void kbd_unpress_key(struct kbd *kb, uint32_t time);
 void kbd_release_key(struct kbd *kb, uint32_t time);
 void kbd_motion_key(struct kbd *kb, uint32_t time, uint32_t x, uint32_t y);
-void kbd_press_key(struct kbd *kb, struct key *k, uint32_t time);
-void kbd_print_key_stdout(struct kbd *kb, struct key *k);
-void kbd_print_first_utf8_char_stdout(const char *str);
+bool kbd_press_prediction(struct kbd *kb, uint32_t x, uint32_t y,
+                          uint32_t time);
+void kbd_set_surrounding_text(struct kbd *kb, const char *text,
+                              uint32_t cursor);
+void kbd_press_key(struct kbd *kb, const struct key *k, uint32_t time);
+void kbd_output_key(struct kbd *kb, const struct key *k, enum stream_event type,
+                    uint32_t time);
 void kbd_clear_last_popup(struct kbd *kb);
-void kbd_draw_key(struct kbd *kb, struct key *k, enum key_draw_type);
+void kbd_draw_key(struct kbd *kb, const struct key *k, enum key_draw_type);
 void kbd_draw_layout(struct kbd *kb);
-void kbd_resize(struct kbd *kb, struct layout *layouts, uint8_t layoutcount);
+void kbd_resize(struct kbd *kb);
+void kbd_rescale(struct kbd *kb);
 uint8_t kbd_get_rows(struct layout *l);
-double kbd_get_row_length(struct key *k);
-void kbd_next_layer(struct kbd *kb, struct key *k, bool invert);
+double kbd_get_row_length(const struct key *k);
+void kbd_next_layer(struct kbd *kb, const struct key *k, bool invert);
+void kbd_set_layout(struct kbd *kb, struct layout *l, size_t layer_index);
 void kbd_switch_layout(struct kbd *kb, struct layout *l, size_t layer_index);
 
+int kbd_prepare_keymap(struct kbd *kb, const char *name, uint32_t comp_unichr,
+                       uint32_t *size);
+void kbd_upload_keymap(struct kbd *kb, int fd, uint32_t size);
 void create_and_upload_keymap(struct kbd *kb, const char *name, uint32_t comp_unichr);
 
-#ifndef LAYOUT
-#error "make sure to define LAYOUT"
-#endif
-#include LAYOUT
+extern const struct builtin_layoutset builtin_layoutsets[];
+extern const size_t builtin_layoutsetcount;
+struct layoutset *kbd_builtin_layoutset(const char *name);
+void kbd_set_layoutset(struct kbd *kb, struct layoutset *ls);
+void kbd_update_layers(struct kbd *kb);
+void kbd_reshape(struct kbd *kb);
+const char *kbd_keymap(struct layoutset *ls, size_t index);
+
 #endif
@@ -0,0 +1,59 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "keymappack.h"
+
+static bool
+keymappack_lzss(const uint8_t *in, size_t size, char *out, size_t length)
+{
+    size_t i = 0, o = 0;
+    while (i < size && o < length) {
+        uint8_t flags = in[i++];
+        for (int bit = 0; bit < 8 && i < size && o < length; bit++) {
+            if (flags & (1 << bit)) {
+                out[o++] = in[i++];
+                continue;
+            }
+            if (i + 2 > size)
+                return false;
+            size_t dist = (in[i] | (in[i + 1] >> 4) << 8) + 1;
+            size_t n = (in[i + 1] & 0x0F) + KEYMAPPACK_MIN_MATCH;
+            i += 2;
+            if (dist > o || n > length - o)
+                return false;
+            // copied byte by byte, a match may overlap what it produces
+            for (; n; n--, o++)
+                out[o] = out[o - dist];
+        }
+    }
+    return o == length;
+}
+
+char *
+keymappack_unpack(const struct keymappack *p, size_t keymap)
+{
+    const struct keymappack_section *s;
+    size_t length = 0;
+
+    if (keymap >= p->keymapcount)
+        return NULL;
+    for (uint32_t i = p->first_part[keymap]; i < p->first_part[keymap + 1];
+         i++)
+        length += p->sections[p->parts[i]].length;
+
+    char *keymap_str = malloc(length + 1);
+    if (!keymap_str)
+        return NULL;
+    char *o = keymap_str;
+    for (uint32_t i = p->first_part[keymap]; i < p->first_part[keymap + 1];
+         i++) {
+        s = &p->sections[p->parts[i]];
+        if (!keymappack_lzss(p->data + s->offset, s->size, o, s->length)) {
+            free(keymap_str);
+            return NULL;
+        }
+        o += s->length;
+    }
+    *o = '\0';
+    return keymap_str;
+}
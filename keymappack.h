@@ -0,0 +1,43 @@
+#ifndef __KEYMAPPACK_H
+#define __KEYMAPPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Packed keymaps
+ *
+ * The keymaps compiled in are packed at build time by tools/packkeymaps.c,
+ * which writes them to keymaps.h in the build directory. A keymap is split into
+ * its sections (xkb_keycodes, xkb_types, xkb_compat, xkb_symbols); sections
+ * that several keymaps share are stored once, and every section is LZSS
+ * compressed. A keymap is unpacked when it is first uploaded.
+ *
+ * LZSS: a flag byte precedes every eight items, its bits from the lowest
+ * telling whether each is a literal byte (1) or a match (0). A match is two
+ * bytes: the low 8 bits of its distance - 1, then the high 4 bits of that in
+ * the upper nibble and its length - KEYMAPPACK_MIN_MATCH in the lower one.
+ */
+
+#define KEYMAPPACK_WINDOW 4096
+#define KEYMAPPACK_MIN_MATCH 3
+#define KEYMAPPACK_MAX_MATCH (KEYMAPPACK_MIN_MATCH + 15)
+
+struct keymappack_section {
+	uint32_t offset; // of its compressed data
+	uint32_t size;   // compressed
+	uint32_t length; // unpacked
+};
+
+struct keymappack {
+	const uint8_t *data;
+	const struct keymappack_section *sections;
+	const uint16_t *parts;      // section indices of all keymaps, in order
+	const uint32_t *first_part; // per keymap, and one past the last
+	size_t keymapcount;
+};
+
+/* Assemble a keymap, NULL if the pack is corrupt. The result is allocated and
+ * NUL terminated. */
+char *keymappack_unpack(const struct keymappack *p, size_t keymap);
+
+#endif
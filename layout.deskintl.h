@@ -55,7 +55,7 @@ enum layout_id {
 	NumLayouts,
 };
 
-static struct key keys_full[], keys_special[], keys_cyrillic[],
+static const struct key keys_full[], keys_special[], keys_cyrillic[],
   keys_compose_a[],
   keys_compose_e[], keys_compose_y[], keys_compose_u[], keys_compose_i[],
   keys_compose_o[], keys_compose_w[], keys_compose_r[], keys_compose_t[],
@@ -145,7 +145,7 @@ static struct layout layouts[NumLayouts] = {
  *
  * - layout: layout to switch to when key is pressed
  */
-static struct key keys_full[] = {
+static const struct key keys_full[] = {
   {"Esc", "Esc", 1.25, Code, KEY_ESC, .scheme = 1},
   {"F1", "F1", 1.0, Code, KEY_F1, .scheme = 1},
   {"F2", "F2", 1.0, Code, KEY_F2, .scheme = 1},
@@ -239,7 +239,7 @@ static struct key keys_full[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_special[] = {
+static const struct key keys_special[] = {
   {"", "", 13.25, Pad},
   {"Ins", "Ins", 1.25, Code, KEY_INSERT, .scheme = 1},
   {"", "", 0.0, EndRow},
@@ -275,7 +275,7 @@ static struct key keys_special[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_cyrillic[] = {
+static const struct key keys_cyrillic[] = {
   {"Esc", "Esc", 1.25, Code, KEY_ESC, .scheme = 1},
   {"F1", "F1", 1.0, Code, KEY_F1, .scheme = 1},
   {"F2", "F2", 1.0, Code, KEY_F2, .scheme = 1},
@@ -369,7 +369,7 @@ static struct key keys_cyrillic[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_a[] = {
+static const struct key keys_compose_a[] = {
   {"à", "À", 1.0, Copy, 0x00E0, 0, 0x00C0},
   {"á", "Á", 1.0, Copy, 0x00E1, 0, 0x00C1},
   {"â", "Â", 1.0, Copy, 0x00E2, 0, 0x00C2},
@@ -392,7 +392,7 @@ static struct key keys_compose_a[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_e[] = {
+static const struct key keys_compose_e[] = {
   {"è", "È", 1.0, Copy, 0x00E8, 0, 0x00C8},
   {"é", "É", 1.0, Copy, 0x00E9, 0, 0x00C9},
   {"ê", "Ê", 1.0, Copy, 0x00EA, 0, 0x00CA},
@@ -416,7 +416,7 @@ static struct key keys_compose_e[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_y[] = {
+static const struct key keys_compose_y[] = {
   {"ý", "Ý", 1.0, Copy, 0x00FD, 0, 0x00DD},
   {"ÿ", "Ÿ", 1.0, Copy, 0x00FF, 0, 0x0178},
   {"ŷ", "Ŷ", 1.0, Copy, 0x0177, 0, 0x0176},
@@ -433,7 +433,7 @@ static struct key keys_compose_y[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_u[] = {
+static const struct key keys_compose_u[] = {
   {"ù", "Ù", 1.0, Copy, 0x00F9, 0, 0x00D9},
   {"ú", "Ú", 1.0, Copy, 0x00FA, 0, 0x00DA},
   {"û", "Û", 1.0, Copy, 0x00FB, 0, 0x00DB},
@@ -456,7 +456,7 @@ static struct key keys_compose_u[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_o[] = {
+static const struct key keys_compose_o[] = {
   {"ò", "Ò", 1.0, Copy, 0x00F2, 0, 0x00D2},
   {"ó", "Ó", 1.0, Copy, 0x00F3, 0, 0x00D3},
   {"ô", "Ô", 1.0, Copy, 0x00F4, 0, 0x00D4},
@@ -480,7 +480,7 @@ static struct key keys_compose_o[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_i[] = {
+static const struct key keys_compose_i[] = {
   {"ì", "Ì", 1.0, Copy, 0x00EC, 0, 0x00CC},
   {"í", "Í", 1.0, Copy, 0x00ED, 0, 0x00CD},
   {"î", "Î", 1.0, Copy, 0x00EE, 0, 0x00CE},
@@ -504,14 +504,14 @@ static struct key keys_compose_i[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_index[] = {
+static const struct key keys_index[] = {
   {"Full", "Full", 1.0, Layout, 0, &layouts[Full], .scheme = 1},
   {"Special", "Special", 1.0, Layout, 0, &layouts[Special], .scheme = 1},
   {"Абв", "Абв", 1.0, Layout, 0, &layouts[Cyrillic], .scheme = 1},
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_w[] = {
+static const struct key keys_compose_w[] = {
   {"ŵ", "Ŵ", 1.0, Copy, 0x0175, 0, 0x0174},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -524,7 +524,7 @@ static struct key keys_compose_w[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_r[] = {
+static const struct key keys_compose_r[] = {
   {"ŕ", "Ŕ", 1.0, Copy, 0x0155, 0, 0x0154},
   {"ŗ", "Ŗ", 1.0, Copy, 0x0157, 0, 0x0156},
   {"ř", "Ř", 1.0, Copy, 0x0159, 0, 0x0158},
@@ -541,7 +541,7 @@ static struct key keys_compose_r[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_t[] = {
+static const struct key keys_compose_t[] = {
   {"ț", "Ț", 1.0, Copy, 0x021B, 0, 0x021A},
   {"ť", "Ť", 1.0, Copy, 0x0165, 0, 0x0164},
   {"ŧ", "Ŧ", 1.0, Copy, 0x0167, 0, 0x0166},
@@ -560,7 +560,7 @@ static struct key keys_compose_t[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_p[] = {
+static const struct key keys_compose_p[] = {
   {"π", "Π", 1.0, Copy, 0x03C0, 0, 0x03A0},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -573,7 +573,7 @@ static struct key keys_compose_p[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_s[] = {
+static const struct key keys_compose_s[] = {
   {"ś", "Ś", 1.0, Copy, 0x015B, 0, 0x015A},
   {"ŝ", "Ŝ", 1.0, Copy, 0x015D, 0, 0x015C},
   {"ş", "Ş", 1.0, Copy, 0x015F, 0, 0x015E},
@@ -593,7 +593,7 @@ static struct key keys_compose_s[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_d[] = {
+static const struct key keys_compose_d[] = {
   {"ð", "Ð", 1.0, Copy, 0x00F0, 0, 0x00D0},
   {"ď", "Ď", 1.0, Copy, 0x010F, 0, 0x010E},
   {"đ", "Đ", 1.0, Copy, 0x0111, 0, 0x0110},
@@ -610,7 +610,7 @@ static struct key keys_compose_d[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_f[] = {
+static const struct key keys_compose_f[] = {
   {"φ", "Φ", 1.0, Copy, 0x03C6, 0, 0x03A6},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -623,7 +623,7 @@ static struct key keys_compose_f[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_g[] = {
+static const struct key keys_compose_g[] = {
   {"ĝ", "Ĝ", 1.0, Copy, 0x011D, 0, 0x011C},
   {"ğ", "Ğ", 1.0, Copy, 0x011F, 0, 0x011E},
   {"", "", 8.0, Pad},
@@ -639,7 +639,7 @@ static struct key keys_compose_g[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_h[] = {
+static const struct key keys_compose_h[] = {
   {"ĥ", "Ĥ", 1.0, Copy, 0x0125, 0, 0x0124},
   {"ħ", "Ħ", 1.0, Copy, 0x0127, 0, 0x0126},
   {"", "", 8.0, Pad},
@@ -655,7 +655,7 @@ static struct key keys_compose_h[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_j[] = {
+static const struct key keys_compose_j[] = {
   {"ĵ", "Ĵ", 1.0, Copy, 0x0135, 0, 0x0134},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -669,7 +669,7 @@ static struct key keys_compose_j[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_k[] = {
+static const struct key keys_compose_k[] = {
   {"ķ", "Ķ", 1.0, Copy, 0x0137, 0, 0x0136},
   {"ǩ", "Ǩ", 1.0, Copy, 0x01E9, 0, 0x01E8},
   {"", "", 8.0, Pad},
@@ -685,7 +685,7 @@ static struct key keys_compose_k[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_l[] = {
+static const struct key keys_compose_l[] = {
   {"ľ", "Ľ", 1.0, Copy, 0x013E, 0, 0x013D},
   {"ŀ", "Ŀ", 1.0, Copy, 0x0140, 0, 0x013F},
   {"ł", "Ł", 1.0, Copy, 0x0142, 0, 0x0141},
@@ -702,7 +702,7 @@ static struct key keys_compose_l[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_z[] = {
+static const struct key keys_compose_z[] = {
   {"ź", "Ź", 1.0, Copy, 0x017A, 0, 0x0179},
   {"ż", "Ż", 1.0, Copy, 0x017C, 0, 0x017B},
   {"ž", "Ž", 1.0, Copy, 0x017E, 0, 0x017D},
@@ -719,7 +719,7 @@ static struct key keys_compose_z[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_x[] = {
+static const struct key keys_compose_x[] = {
   {"χ", "Χ", 1.0, Copy, 0x03C7, 0, 0x03A7},
   {"ξ", "Ξ", 1.0, Copy, 0x03BE, 0, 0x039E},
   {"", "", 9.0, Pad},
@@ -733,7 +733,7 @@ static struct key keys_compose_x[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_c[] = {
+static const struct key keys_compose_c[] = {
   {"ç", "Ç", 1.0, Copy, 0x00E7, 0, 0x00C7},
   {"ć", "Ć", 1.0, Copy, 0x0107, 0, 0x0106},
   {"ĉ", "Ĉ", 1.0, Copy, 0x0109, 0, 0x0108},
@@ -752,7 +752,7 @@ static struct key keys_compose_c[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_v[] = {
+static const struct key keys_compose_v[] = {
   {"", "", 0.0, EndRow},
   {"", "", 0.0, EndRow},
   {"⇧", "⇫", 1.5, Mod, Shift, .scheme = 1},
@@ -763,7 +763,7 @@ static struct key keys_compose_v[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_b[] = {
+static const struct key keys_compose_b[] = {
   {"β", "Β", 1.0, Copy, 0x03B2, 0, 0x0392},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -776,7 +776,7 @@ static struct key keys_compose_b[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_n[] = {
+static const struct key keys_compose_n[] = {
   {"ñ", "Ñ", 1.0, Copy, 0x00F1, 0, 0x00D1},
   {"ń", "Ń", 1.0, Copy, 0x0144, 0, 0x0143},
   {"ņ", "Ņ", 1.0, Copy, 0x0146, 0, 0x0145},
@@ -795,7 +795,7 @@ static struct key keys_compose_n[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_m[] = {
+static const struct key keys_compose_m[] = {
   {"μ", "Μ", 1.0, Copy, 0x03BC, 0, 0x039C},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -808,7 +808,7 @@ static struct key keys_compose_m[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_math[] = {
+static const struct key keys_compose_math[] = {
   {"", "", 0.0, EndRow},
   {"", "", 0.0, EndRow},
   {"⇧", "⇫", 1.5, Mod, Shift, .scheme = 1},
@@ -826,7 +826,7 @@ static struct key keys_compose_math[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_punctuation[] = {
+static const struct key keys_compose_punctuation[] = {
   {"", "", 0.0, EndRow},
   {"", "", 4.5, Pad},
   {".", ".", 1, Code, KEY_DOT},
@@ -849,7 +849,7 @@ static struct key keys_compose_punctuation[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_bracket[] = {
+static const struct key keys_compose_bracket[] = {
   {"", "", 0, EndRow},
   {"", "", 1.5, Pad},
   {"{", "{", 1, Code, KEY_LEFTBRACE, 0, Shift},
@@ -872,7 +872,7 @@ static struct key keys_compose_bracket[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_i[] = {
+static const struct key keys_compose_cyr_i[] = {
   {"і", "І", 1.0, Copy, 0x0456, 0, 0x0406},
   {"ї", "Ї", 1.0, Copy, 0x0457, 0, 0x0407},
   {"", "", 8.0, Pad},
@@ -886,7 +886,7 @@ static struct key keys_compose_cyr_i[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_j[] = {
+static const struct key keys_compose_cyr_j[] = {
   {"ј", "Ј", 1.0, Copy, 0x0458, 0, 0x0408},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -899,7 +899,7 @@ static struct key keys_compose_cyr_j[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_e[] = {
+static const struct key keys_compose_cyr_e[] = {
   {"є", "Є", 1.0, Copy, 0x0454, 0, 0x0404},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -912,7 +912,7 @@ static struct key keys_compose_cyr_e[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_u[] = {
+static const struct key keys_compose_cyr_u[] = {
   {"ў", "Ў", 1.0, Copy, 0x045E, 0, 0x040E},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -925,7 +925,7 @@ static struct key keys_compose_cyr_u[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_l[] = {
+static const struct key keys_compose_cyr_l[] = {
   {"љ", "Љ", 1.0, Copy, 0x0459, 0, 0x0409},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -938,7 +938,7 @@ static struct key keys_compose_cyr_l[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_n[] = {
+static const struct key keys_compose_cyr_n[] = {
   {"њ", "Њ", 1.0, Copy, 0x045A, 0, 0x040A},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -951,7 +951,7 @@ static struct key keys_compose_cyr_n[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_che[] = {
+static const struct key keys_compose_cyr_che[] = {
   {"ћ", "Ћ", 1.0, Copy, 0x045B, 0, 0x040B},
   {"ђ", "Ђ", 1.0, Copy, 0x0452, 0, 0x0402},
   {"", "", 8.0, Pad},
@@ -965,7 +965,7 @@ static struct key keys_compose_cyr_che[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_tse[] = {
+static const struct key keys_compose_cyr_tse[] = {
   {"џ", "Џ", 1.0, Copy, 0x045F, 0, 0x040F},
   {"ѕ", "Ѕ", 1.0, Copy, 0x0455, 0, 0x0405},
   {"", "", 8.0, Pad},
@@ -979,7 +979,7 @@ static struct key keys_compose_cyr_tse[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_g[] = {
+static const struct key keys_compose_cyr_g[] = {
   {"ѓ", "Ѓ", 1.0, Copy, 0x0453, 0, 0x0403},
   {"ґ", "Ґ", 1.0, Copy, 0x0491, 0, 0x0490},
   {"", "", 8.0, Pad},
@@ -993,7 +993,7 @@ static struct key keys_compose_cyr_g[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_k[] = {
+static const struct key keys_compose_cyr_k[] = {
   {"ќ", "Ќ", 1.0, Copy, 0x0453, 0, 0x040C},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -68,7 +68,7 @@ enum layout_id {
 	NumLayouts,
 };
 
-static struct key keys_full[], keys_full_wide[], keys_special[], keys_specialpad[], keys_simple[],
+static const struct key keys_full[], keys_full_wide[], keys_special[], keys_specialpad[], keys_simple[],
   keys_cyrillic[], keys_arabic[], keys_persian[], keys_georgian[], keys_greek[], keys_hebrew[],
   keys_emoji[], keys_nav[], keys_landscape[], keys_landscape_special[], keys_compose_a[],
   keys_compose_e[], keys_compose_y[], keys_compose_u[], keys_compose_i[],
@@ -172,7 +172,7 @@ static struct layout layouts[NumLayouts] = {
  *
  * - layout: layout to switch to when key is pressed
  */
-static struct key keys_full[] = {
+static const struct key keys_full[] = {
   {"Esc", "Esc", 1.0, Code, KEY_ESC, .scheme = 1},
   {"Ctr", "Ctr", 1.0, Mod, Ctrl, .scheme = 1},
   {"↑", "↑", 1.0, Code, KEY_UP, .scheme = 1},
@@ -244,7 +244,7 @@ static struct key keys_full[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_full_wide[] = {
+static const struct key keys_full_wide[] = {
   {"Esc", "Esc", 1.0, Code, KEY_ESC, .scheme = 1},
   {"Ctr", "Ctr", 1.0, Mod, Ctrl, .scheme = 1},
   {"↑", "↑", 1.0, Code, KEY_UP, .scheme = 1},
@@ -318,7 +318,7 @@ static struct key keys_full_wide[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_special[] = {
+static const struct key keys_special[] = {
   {"Esc", "Esc", 1.0, Code, KEY_ESC, .scheme = 1},
   {"Alt", "Alt", 1.0, Mod, Alt, .scheme = 1},
   {"↑", "↑", 1.0, Code, KEY_UP, .scheme = 1},
@@ -377,7 +377,7 @@ static struct key keys_special[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_specialpad[] = {
+static const struct key keys_specialpad[] = {
   {"⎋", "⎋", 1.0, Code, KEY_ESC, .scheme = 1},
   {"↑", "↑", 1.0, Code, KEY_UP, .scheme = 1},
   {"⇈", "⇈", 1.0, Code, KEY_PAGEUP, .scheme = 1},
@@ -429,7 +429,7 @@ static struct key keys_specialpad[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_simple[] = {
+static const struct key keys_simple[] = {
   {"q", "Q", 1.0, Code, KEY_Q, &layouts[Emoji]},
   {"w", "W", 1.0, Code, KEY_W, &layouts[ComposeW]},
   {"e", "E", 1.0, Code, KEY_E, &layouts[ComposeE]},
@@ -479,7 +479,7 @@ static struct key keys_simple[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_dialer[] = {
+static const struct key keys_dialer[] = {
   {"Esc", "Esc", 1.0, Code, KEY_ESC},
   {"+","+", 1.0, Code, KEY_KPPLUS},
   {"⌫", "⌫", 1.0, Code, KEY_BACKSPACE},
@@ -507,7 +507,7 @@ static struct key keys_dialer[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_cyrillic[] = {
+static const struct key keys_cyrillic[] = {
   {"1", "!", 1.0, Code, KEY_1},
   {"2", "@", 1.0, Code, KEY_2},
   {"3", "#", 1.0, Code, KEY_3},
@@ -573,7 +573,7 @@ static struct key keys_cyrillic[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_arabic[] = {
+static const struct key keys_arabic[] = {
   {"١", "!", 1.0, Code, KEY_1},
   {"٢", "@", 1.0, Code, KEY_2},
   {"٣", "#", 1.0, Code, KEY_3},
@@ -636,7 +636,7 @@ static struct key keys_arabic[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_georgian[] = {
+static const struct key keys_georgian[] = {
   {"1", "!", 1.0, Code, KEY_1},
   {"2", "@", 1.0, Code, KEY_2},
   {"3", "#", 1.0, Code, KEY_3},
@@ -696,7 +696,7 @@ static struct key keys_georgian[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_persian[] = {
+static const struct key keys_persian[] = {
   {"۱", "|", 1.0, Code, KEY_1},
   {"۲", "٬", 1.0, Code, KEY_2},
   {"۳", "#", 1.0, Code, KEY_3},
@@ -763,7 +763,7 @@ static struct key keys_persian[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_greek[] = {
+static const struct key keys_greek[] = {
   {"1", "!", 1.0, Code, KEY_1},
   {"2", "@", 1.0, Code, KEY_2},
   {"3", "#", 1.0, Code, KEY_3},
@@ -824,7 +824,7 @@ static struct key keys_greek[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_hebrew[] = {
+static const struct key keys_hebrew[] = {
   {"/", "/", 1.0, Code, KEY_Q},
   {"'", "'", 1.0, Code, KEY_W, &layouts[ComposeBracket]},
   {"ק", "ק", 1.0, Code, KEY_E},
@@ -874,7 +874,7 @@ static struct key keys_hebrew[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_a[] = {
+static const struct key keys_compose_a[] = {
   {"à", "À", 1.0, Copy, 0x00E0, 0, 0x00C0},
   {"á", "Á", 1.0, Copy, 0x00E1, 0, 0x00C1},
   {"â", "Â", 1.0, Copy, 0x00E2, 0, 0x00C2},
@@ -897,7 +897,7 @@ static struct key keys_compose_a[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_e[] = {
+static const struct key keys_compose_e[] = {
   {"è", "È", 1.0, Copy, 0x00E8, 0, 0x00C8},
   {"é", "É", 1.0, Copy, 0x00E9, 0, 0x00C9},
   {"ê", "Ê", 1.0, Copy, 0x00EA, 0, 0x00CA},
@@ -921,7 +921,7 @@ static struct key keys_compose_e[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_y[] = {
+static const struct key keys_compose_y[] = {
   {"ý", "Ý", 1.0, Copy, 0x00FD, 0, 0x00DD},
   {"ÿ", "Ÿ", 1.0, Copy, 0x00FF, 0, 0x0178},
   {"ŷ", "Ŷ", 1.0, Copy, 0x0177, 0, 0x0176},
@@ -938,7 +938,7 @@ static struct key keys_compose_y[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_u[] = {
+static const struct key keys_compose_u[] = {
   {"ù", "Ù", 1.0, Copy, 0x00F9, 0, 0x00D9},
   {"ú", "Ú", 1.0, Copy, 0x00FA, 0, 0x00DA},
   {"û", "Û", 1.0, Copy, 0x00FB, 0, 0x00DB},
@@ -961,7 +961,7 @@ static struct key keys_compose_u[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_o[] = {
+static const struct key keys_compose_o[] = {
   {"ò", "Ò", 1.0, Copy, 0x00F2, 0, 0x00D2},
   {"ó", "Ó", 1.0, Copy, 0x00F3, 0, 0x00D3},
   {"ô", "Ô", 1.0, Copy, 0x00F4, 0, 0x00D4},
@@ -985,7 +985,7 @@ static struct key keys_compose_o[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_i[] = {
+static const struct key keys_compose_i[] = {
   {"ì", "Ì", 1.0, Copy, 0x00EC, 0, 0x00CC},
   {"í", "Í", 1.0, Copy, 0x00ED, 0, 0x00CD},
   {"î", "Î", 1.0, Copy, 0x00EE, 0, 0x00CE},
@@ -1009,7 +1009,7 @@ static struct key keys_compose_i[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_emoji[] = {
+static const struct key keys_emoji[] = {
   {"🙂", "🙏", 1.0, Copy, 0x1f642, 0, 0x1f64f}, // Emojis
   {"😀", "🙋", 1.0, Copy, 0x1f600, 0, 0x1f64b},
   {"😁", "✋", 1.0, Copy, 0x1f601, 0, 0x270B},
@@ -1056,7 +1056,7 @@ static struct key keys_emoji[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_nav[] = {
+static const struct key keys_nav[] = {
   {"Esc", "Esc", 1.0, Code, KEY_ESC, .scheme = 1},
   {"⌫", "⌫", 1.0, Code, KEY_BACKSPACE, .scheme = 1},
   {"↑", "↑", 1.0, Code, KEY_UP, .scheme = 1},
@@ -1076,7 +1076,7 @@ static struct key keys_nav[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_index[] = {
+static const struct key keys_index[] = {
   {"Full", "Full", 1.0, Layout, 0, &layouts[Full], .scheme = 1},
   {"Wide", "Wide", 0.75, Layout, 0, &layouts[Full]},
   {"Landscape", "Landscape", 1.5, Layout, 0,  &layouts[Landscape], .scheme = 1},
@@ -1101,7 +1101,7 @@ static struct key keys_index[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_landscape[] = {
+static const struct key keys_landscape[] = {
   {"Esc", "Esc", 1.0, Code, KEY_ESC, .scheme = 1},
   {"", "", 0.5, Pad, .scheme = 1},
   {"q", "Q", 1.0, Code, KEY_Q, &layouts[Emoji]},
@@ -1161,7 +1161,7 @@ static struct key keys_landscape[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_landscape_special[] = {
+static const struct key keys_landscape_special[] = {
   {"Esc", "Esc", 1.0, Code, KEY_ESC, .scheme = 1},
   {"", "", 0.5, Pad, .scheme = 1},
   {"1", "!", 1.0, Code, KEY_1},
@@ -1220,7 +1220,7 @@ static struct key keys_landscape_special[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_w[] = {
+static const struct key keys_compose_w[] = {
   {"ŵ", "Ŵ", 1.0, Copy, 0x0175, 0, 0x0174},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1233,7 +1233,7 @@ static struct key keys_compose_w[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_r[] = {
+static const struct key keys_compose_r[] = {
   {"ŕ", "Ŕ", 1.0, Copy, 0x0155, 0, 0x0154},
   {"ŗ", "Ŗ", 1.0, Copy, 0x0157, 0, 0x0156},
   {"ř", "Ř", 1.0, Copy, 0x0159, 0, 0x0158},
@@ -1250,7 +1250,7 @@ static struct key keys_compose_r[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_t[] = {
+static const struct key keys_compose_t[] = {
   {"ț", "Ț", 1.0, Copy, 0x021B, 0, 0x021A},
   {"ť", "Ť", 1.0, Copy, 0x0165, 0, 0x0164},
   {"ŧ", "Ŧ", 1.0, Copy, 0x0167, 0, 0x0166},
@@ -1269,7 +1269,7 @@ static struct key keys_compose_t[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_p[] = {
+static const struct key keys_compose_p[] = {
   {"π", "Π", 1.0, Copy, 0x03C0, 0, 0x03A0},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1282,7 +1282,7 @@ static struct key keys_compose_p[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_s[] = {
+static const struct key keys_compose_s[] = {
   {"ś", "Ś", 1.0, Copy, 0x015B, 0, 0x015A},
   {"ŝ", "Ŝ", 1.0, Copy, 0x015D, 0, 0x015C},
   {"ş", "Ş", 1.0, Copy, 0x015F, 0, 0x015E},
@@ -1302,7 +1302,7 @@ static struct key keys_compose_s[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_d[] = {
+static const struct key keys_compose_d[] = {
   {"ð", "Ð", 1.0, Copy, 0x00F0, 0, 0x00D0},
   {"ď", "Ď", 1.0, Copy, 0x010F, 0, 0x010E},
   {"đ", "Đ", 1.0, Copy, 0x0111, 0, 0x0110},
@@ -1319,7 +1319,7 @@ static struct key keys_compose_d[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_f[] = {
+static const struct key keys_compose_f[] = {
   {"φ", "Φ", 1.0, Copy, 0x03C6, 0, 0x03A6},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1332,7 +1332,7 @@ static struct key keys_compose_f[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_g[] = {
+static const struct key keys_compose_g[] = {
   {"ĝ", "Ĝ", 1.0, Copy, 0x011D, 0, 0x011C},
   {"ğ", "Ğ", 1.0, Copy, 0x011F, 0, 0x011E},
   {"", "", 8.0, Pad},
@@ -1348,7 +1348,7 @@ static struct key keys_compose_g[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_h[] = {
+static const struct key keys_compose_h[] = {
   {"ĥ", "Ĥ", 1.0, Copy, 0x0125, 0, 0x0124},
   {"ħ", "Ħ", 1.0, Copy, 0x0127, 0, 0x0126},
   {"", "", 8.0, Pad},
@@ -1364,7 +1364,7 @@ static struct key keys_compose_h[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_j[] = {
+static const struct key keys_compose_j[] = {
   {"ĵ", "Ĵ", 1.0, Copy, 0x0135, 0, 0x0134},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1378,7 +1378,7 @@ static struct key keys_compose_j[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_k[] = {
+static const struct key keys_compose_k[] = {
   {"ķ", "Ķ", 1.0, Copy, 0x0137, 0, 0x0136},
   {"ǩ", "Ǩ", 1.0, Copy, 0x01E9, 0, 0x01E8},
   {"", "", 8.0, Pad},
@@ -1394,7 +1394,7 @@ static struct key keys_compose_k[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_l[] = {
+static const struct key keys_compose_l[] = {
   {"ľ", "Ľ", 1.0, Copy, 0x013E, 0, 0x013D},
   {"ŀ", "Ŀ", 1.0, Copy, 0x0140, 0, 0x013F},
   {"ł", "Ł", 1.0, Copy, 0x0142, 0, 0x0141},
@@ -1411,7 +1411,7 @@ static struct key keys_compose_l[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_z[] = {
+static const struct key keys_compose_z[] = {
   {"ź", "Ź", 1.0, Copy, 0x017A, 0, 0x0179},
   {"ż", "Ż", 1.0, Copy, 0x017C, 0, 0x017B},
   {"ž", "Ž", 1.0, Copy, 0x017E, 0, 0x017D},
@@ -1428,7 +1428,7 @@ static struct key keys_compose_z[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_x[] = {
+static const struct key keys_compose_x[] = {
   {"χ", "Χ", 1.0, Copy, 0x03C7, 0, 0x03A7},
   {"ξ", "Ξ", 1.0, Copy, 0x03BE, 0, 0x039E},
   {"", "", 9.0, Pad},
@@ -1442,7 +1442,7 @@ static struct key keys_compose_x[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_c[] = {
+static const struct key keys_compose_c[] = {
   {"ç", "Ç", 1.0, Copy, 0x00E7, 0, 0x00C7},
   {"ć", "Ć", 1.0, Copy, 0x0107, 0, 0x0106},
   {"ĉ", "Ĉ", 1.0, Copy, 0x0109, 0, 0x0108},
@@ -1461,7 +1461,7 @@ static struct key keys_compose_c[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_v[] = {
+static const struct key keys_compose_v[] = {
   {"", "", 0.0, EndRow},
   {"", "", 0.0, EndRow},
   {"⇧", "⇫", 1.5, Mod, Shift, .scheme = 1},
@@ -1472,7 +1472,7 @@ static struct key keys_compose_v[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_b[] = {
+static const struct key keys_compose_b[] = {
   {"β", "Β", 1.0, Copy, 0x03B2, 0, 0x0392},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1485,7 +1485,7 @@ static struct key keys_compose_b[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_n[] = {
+static const struct key keys_compose_n[] = {
   {"ñ", "Ñ", 1.0, Copy, 0x00F1, 0, 0x00D1},
   {"ń", "Ń", 1.0, Copy, 0x0144, 0, 0x0143},
   {"ņ", "Ņ", 1.0, Copy, 0x0146, 0, 0x0145},
@@ -1504,7 +1504,7 @@ static struct key keys_compose_n[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_m[] = {
+static const struct key keys_compose_m[] = {
   {"μ", "Μ", 1.0, Copy, 0x03BC, 0, 0x039C},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1517,7 +1517,7 @@ static struct key keys_compose_m[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_i[] = {
+static const struct key keys_compose_cyr_i[] = {
   {"і", "І", 1.0, Copy, 0x0456, 0, 0x0406},
   {"ї", "Ї", 1.0, Copy, 0x0457, 0, 0x0407},
   {"", "", 8.0, Pad},
@@ -1531,7 +1531,7 @@ static struct key keys_compose_cyr_i[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_j[] = {
+static const struct key keys_compose_cyr_j[] = {
   {"ј", "Ј", 1.0, Copy, 0x0458, 0, 0x0408},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1544,7 +1544,7 @@ static struct key keys_compose_cyr_j[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_e[] = {
+static const struct key keys_compose_cyr_e[] = {
   {"є", "Є", 1.0, Copy, 0x0454, 0, 0x0404},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1557,7 +1557,7 @@ static struct key keys_compose_cyr_e[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_u[] = {
+static const struct key keys_compose_cyr_u[] = {
   {"ў", "Ў", 1.0, Copy, 0x045E, 0, 0x040E},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1570,7 +1570,7 @@ static struct key keys_compose_cyr_u[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_l[] = {
+static const struct key keys_compose_cyr_l[] = {
   {"љ", "Љ", 1.0, Copy, 0x0459, 0, 0x0409},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1583,7 +1583,7 @@ static struct key keys_compose_cyr_l[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_n[] = {
+static const struct key keys_compose_cyr_n[] = {
   {"њ", "Њ", 1.0, Copy, 0x045A, 0, 0x040A},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1596,7 +1596,7 @@ static struct key keys_compose_cyr_n[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_che[] = {
+static const struct key keys_compose_cyr_che[] = {
   {"ћ", "Ћ", 1.0, Copy, 0x045B, 0, 0x040B},
   {"ђ", "Ђ", 1.0, Copy, 0x0452, 0, 0x0402},
   {"", "", 8.0, Pad},
@@ -1610,7 +1610,7 @@ static struct key keys_compose_cyr_che[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_tse[] = {
+static const struct key keys_compose_cyr_tse[] = {
   {"џ", "Џ", 1.0, Copy, 0x045F, 0, 0x040F},
   {"ѕ", "Ѕ", 1.0, Copy, 0x0455, 0, 0x0405},
   {"", "", 8.0, Pad},
@@ -1624,7 +1624,7 @@ static struct key keys_compose_cyr_tse[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_g[] = {
+static const struct key keys_compose_cyr_g[] = {
   {"ѓ", "Ѓ", 1.0, Copy, 0x0453, 0, 0x0403},
   {"ґ", "Ґ", 1.0, Copy, 0x0491, 0, 0x0490},
   {"", "", 8.0, Pad},
@@ -1638,7 +1638,7 @@ static struct key keys_compose_cyr_g[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_cyr_k[] = {
+static const struct key keys_compose_cyr_k[] = {
   {"ќ", "Ќ", 1.0, Copy, 0x0453, 0, 0x040C},
   {"", "", 9.0, Pad},
   {"", "", 0.0, EndRow},
@@ -1651,7 +1651,7 @@ static struct key keys_compose_cyr_k[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_math[] = {
+static const struct key keys_compose_math[] = {
   {"", "", 0.0, EndRow},
   {"", "", 0.0, EndRow},
   {"⇧", "⇫", 1.5, Mod, Shift, .scheme = 1},
@@ -1669,7 +1669,7 @@ static struct key keys_compose_math[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_punctuation[] = {
+static const struct key keys_compose_punctuation[] = {
   {"", "", 0.0, EndRow},
   {"", "", 4.5, Pad},
   {".", ".", 1, Code, KEY_DOT},
@@ -1692,7 +1692,7 @@ static struct key keys_compose_punctuation[] = {
   {"", "", 0.0, Last},
 };
 
-static struct key keys_compose_bracket[] = {
+static const struct key keys_compose_bracket[] = {
   {"", "", 0, EndRow},
   {"", "", 1.5, Pad},
   {"{", "{", 1, Code, KEY_LEFTBRACE, 0, Shift},
@@ -0,0 +1,389 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "layoutfile.h"
+
+/* strings are deduplicated while writing, labels repeat a lot */
+struct strtab {
+    char *data;
+    uint32_t size, cap;
+};
+
+static bool
+layoutfile_range(const struct layoutfile_header *h, uint32_t offset,
+                 uint32_t count, size_t elsize)
+{
+    return offset <= h->size &&
+           (uint64_t)count * elsize <= (uint64_t)(h->size - offset);
+}
+
+static const char *
+layoutfile_string(const struct layoutfile_header *h, uint32_t offset)
+{
+    if (offset == LAYOUTFILE_NONE)
+        return NULL;
+    return (const char *)h + h->strings_offset + offset;
+}
+
+static bool
+layoutfile_check_string(const struct layoutfile_header *h, uint32_t offset,
+                        bool optional)
+{
+    if (offset == LAYOUTFILE_NONE)
+        return optional;
+    return offset < h->strings_size;
+}
+
+/* keymaps are used as printf templates, only allow the two %08X conversions
+ * create_and_upload_keymap passes */
+static bool
+layoutfile_check_keymap(const char *keymap)
+{
+    int conversions = 0;
+    for (const char *p = keymap; (p = strchr(p, '%')); p += 4) {
+        if (strncmp(p, "%08X", 4) != 0)
+            return false;
+        conversions++;
+    }
+    return conversions == 2;
+}
+
+static bool
+layoutfile_check(const struct layoutfile_header *h, size_t schemecount)
+{
+    const struct layoutfile_layout *fl;
+    const struct layoutfile_key *fk;
+    const struct layoutfile_keymap *fm;
+    const char *strings;
+
+    if (memcmp(h->magic, LAYOUTFILE_MAGIC, sizeof(h->magic)) != 0) {
+        fprintf(stderr, "not a layout file\n");
+        return false;
+    }
+    if (h->version != LAYOUTFILE_VERSION) {
+        fprintf(stderr, "unsupported layout file version %u\n", h->version);
+        return false;
+    }
+    if (h->byteorder != LAYOUTFILE_BYTEORDER) {
+        fprintf(stderr, "layout file has foreign byte order\n");
+        return false;
+    }
+    if (!layoutfile_range(h, h->layouts_offset, h->layoutcount,
+                          sizeof(struct layoutfile_layout)) ||
+        !layoutfile_range(h, h->keys_offset, h->keycount,
+                          sizeof(struct layoutfile_key)) ||
+        !layoutfile_range(h, h->keymaps_offset, h->keymapcount,
+                          sizeof(struct layoutfile_keymap)) ||
+        !layoutfile_range(h, h->strings_offset, h->strings_size, 1) ||
+        h->layouts_offset % 4 || h->keys_offset % 4 || h->keymaps_offset % 4) {
+        fprintf(stderr, "layout file is truncated or corrupt\n");
+        return false;
+    }
+
+    strings = (const char *)h + h->strings_offset;
+    if (h->strings_size == 0 || strings[h->strings_size - 1] != '\0') {
+        fprintf(stderr, "layout file string table is not terminated\n");
+        return false;
+    }
+
+    if (h->layoutcount == 0 || h->index >= h->layoutcount ||
+        h->layercount == 0 || h->layercount > MAX_LAYERS ||
+        h->landscape_layercount == 0 ||
+        h->landscape_layercount > MAX_LAYERS) {
+        fprintf(stderr, "layout file defines no usable layers\n");
+        return false;
+    }
+    for (uint32_t i = 0; i < h->layercount; i++) {
+        if (h->layers[i] >= h->layoutcount || h->layers[i] == h->index) {
+            fprintf(stderr, "layout file has an invalid layer %u\n", i);
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < h->landscape_layercount; i++) {
+        if (h->landscape_layers[i] >= h->layoutcount ||
+            h->landscape_layers[i] == h->index) {
+            fprintf(stderr, "layout file has an invalid landscape layer %u\n",
+                    i);
+            return false;
+        }
+    }
+
+    fm = (const void *)((const char *)h + h->keymaps_offset);
+    for (uint32_t i = 0; i < h->keymapcount; i++) {
+        if (!layoutfile_check_string(h, fm[i].name, false) ||
+            !layoutfile_check_string(h, fm[i].keymap, false) ||
+            !layoutfile_check_keymap(layoutfile_string(h, fm[i].keymap))) {
+            fprintf(stderr, "layout file has an invalid keymap\n");
+            return false;
+        }
+    }
+
+    fl = (const void *)((const char *)h + h->layouts_offset);
+    fk = (const void *)((const char *)h + h->keys_offset);
+    for (uint32_t i = 0; i < h->layoutcount; i++) {
+        if (!layoutfile_check_string(h, fl[i].name, true) ||
+            !layoutfile_check_string(h, fl[i].keymap_name, false) ||
+            fl[i].keycount == 0 || fl[i].first_key >= h->keycount ||
+            fl[i].keycount > h->keycount - fl[i].first_key ||
+            fk[fl[i].first_key + fl[i].keycount - 1].type != Last) {
+            fprintf(stderr, "layout file has an invalid layout %u\n", i);
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < h->keycount; i++) {
+        if (!layoutfile_check_string(h, fk[i].label, false) ||
+            !layoutfile_check_string(h, fk[i].shift_label, false) ||
+            fk[i].type > Last || !isfinite(fk[i].width) ||
+            fk[i].width < 0 || fk[i].scheme >= schemecount ||
+            (fk[i].layout != LAYOUTFILE_NONE &&
+             fk[i].layout >= h->layoutcount) ||
+            // a layout key switches to its layout
+            (fk[i].type == Layout && fk[i].layout == LAYOUTFILE_NONE)) {
+            fprintf(stderr, "layout file has an invalid key %u\n", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct layoutset *
+layoutfile_load(const char *path, const struct layoutset *defaults)
+{
+    const struct layoutfile_header *h;
+    const struct layoutfile_layout *fl;
+    const struct layoutfile_key *fk;
+    const struct layoutfile_keymap *fm;
+    struct layoutset *ls;
+    struct layout *layouts;
+    struct key *keys;
+    const char **keymap_names, **keymaps;
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*h) ||
+        st.st_size > UINT32_MAX) {
+        fprintf(stderr, "%s: not a layout file\n", path);
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+
+    h = map;
+    if (h->size != st.st_size || !layoutfile_check(h, defaults->schemecount)) {
+        fprintf(stderr, "%s: could not load layout file\n", path);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    fl = (const void *)((const char *)h + h->layouts_offset);
+    fk = (const void *)((const char *)h + h->keys_offset);
+    fm = (const void *)((const char *)h + h->keymaps_offset);
+
+    ls = calloc(1, sizeof(*ls));
+    layouts = calloc(h->layoutcount, sizeof(*layouts));
+    keys = calloc(h->keycount, sizeof(*keys));
+    keymap_names = calloc(h->keymapcount, sizeof(*keymap_names));
+    keymaps = calloc(h->keymapcount, sizeof(*keymaps));
+    ls->layers = calloc(h->layercount, sizeof(size_t));
+    ls->landscape_layers = calloc(h->landscape_layercount, sizeof(size_t));
+
+    /* struct key is const, so build each one and copy it into place */
+    for (uint32_t i = 0; i < h->keycount; i++) {
+        struct key k = {
+            .label = layoutfile_string(h, fk[i].label),
+            .shift_label = layoutfile_string(h, fk[i].shift_label),
+            .width = fk[i].width,
+            .type = fk[i].type,
+            .code = fk[i].code,
+            .layout = fk[i].layout == LAYOUTFILE_NONE
+                          ? NULL
+                          : &layouts[fk[i].layout],
+            .code_mod = fk[i].code_mod,
+            .scheme = fk[i].scheme,
+            .reset_mod = fk[i].reset_mod,
+        };
+        memcpy(&keys[i], &k, sizeof(k));
+    }
+    for (uint32_t i = 0; i < h->layoutcount; i++) {
+        layouts[i].keys = &keys[fl[i].first_key];
+        layouts[i].keymap_name = layoutfile_string(h, fl[i].keymap_name);
+        layouts[i].name = layoutfile_string(h, fl[i].name);
+        layouts[i].abc = fl[i].abc;
+    }
+    for (uint32_t i = 0; i < h->keymapcount; i++) {
+        keymap_names[i] = layoutfile_string(h, fm[i].name);
+        keymaps[i] = layoutfile_string(h, fm[i].keymap);
+    }
+    for (uint32_t i = 0; i < h->layercount; i++)
+        ls->layers[i] = h->layers[i];
+    for (uint32_t i = 0; i < h->landscape_layercount; i++)
+        ls->landscape_layers[i] = h->landscape_layers[i];
+
+    ls->layouts = layouts;
+    ls->layoutcount = h->layoutcount;
+    ls->index = h->index;
+    ls->keymap_names = keymap_names;
+    ls->keymaps = keymaps;
+    ls->keymapcount = h->keymapcount;
+    ls->layercount = h->layercount;
+    ls->landscape_layercount = h->landscape_layercount;
+
+    /* a layout file only holds layouts, the rest is configured at build time */
+    ls->schemes = defaults->schemes;
+    ls->schemecount = defaults->schemecount;
+    ls->content_purpose_layouts = defaults->content_purpose_layouts;
+    ls->height = defaults->height;
+    ls->landscape_height = defaults->landscape_height;
+    ls->key_border = defaults->key_border;
+    ls->repeat_delay = defaults->repeat_delay;
+    ls->repeat_rate = defaults->repeat_rate;
+    ls->long_press_delay = defaults->long_press_delay;
+    ls->shift_space_is_tab = defaults->shift_space_is_tab;
+
+    fprintf(stderr, "Loaded %u layouts and %u keymaps from %s\n",
+            h->layoutcount, h->keymapcount, path);
+    return ls;
+}
+
+static uint32_t
+strtab_add(struct strtab *st, const char *s)
+{
+    uint32_t len, off = 0;
+
+    if (!s)
+        return LAYOUTFILE_NONE;
+    len = strlen(s) + 1;
+    while (off < st->size) {
+        if (!strcmp(st->data + off, s))
+            return off;
+        off += strlen(st->data + off) + 1;
+    }
+    if (st->size + len > st->cap) {
+        st->cap = (st->size + len) * 2;
+        st->data = realloc(st->data, st->cap);
+    }
+    memcpy(st->data + st->size, s, len);
+    st->size += len;
+    return off;
+}
+
+int
+layoutfile_write(struct layoutset *ls, const char *path)
+{
+    struct layoutfile_header h = {0};
+    struct layoutfile_layout *fl;
+    struct layoutfile_key *fk;
+    struct layoutfile_keymap *fm;
+    struct strtab st = {0};
+    uint32_t keycount = 0;
+    FILE *f;
+    int ret = 0;
+
+    for (size_t i = 0; i < ls->layoutcount; i++) {
+        const struct key *k = ls->layouts[i].keys;
+        while (k->type != Last)
+            k++;
+        keycount += k - ls->layouts[i].keys + 1;
+    }
+
+    fl = calloc(ls->layoutcount, sizeof(*fl));
+    fk = calloc(keycount, sizeof(*fk));
+    fm = calloc(ls->keymapcount, sizeof(*fm));
+
+    keycount = 0;
+    for (size_t i = 0; i < ls->layoutcount; i++) {
+        struct layout *l = &ls->layouts[i];
+        const struct key *k = l->keys;
+
+        fl[i].name = strtab_add(&st, l->name);
+        fl[i].keymap_name = strtab_add(&st, l->keymap_name);
+        fl[i].first_key = keycount;
+        fl[i].abc = l->abc;
+        do {
+            struct layoutfile_key *o = &fk[keycount++];
+            o->label = strtab_add(&st, k->label);
+            o->shift_label = strtab_add(&st, k->shift_label);
+            o->width = k->width;
+            o->code = k->code;
+            o->code_mod = k->code_mod;
+            o->layout = LAYOUTFILE_NONE;
+            if (k->layout >= ls->layouts &&
+                k->layout < ls->layouts + ls->layoutcount)
+                o->layout = k->layout - ls->layouts;
+            o->type = k->type;
+            o->scheme = k->scheme;
+            o->reset_mod = k->reset_mod;
+        } while ((k++)->type != Last);
+        fl[i].keycount = keycount - fl[i].first_key;
+    }
+
+    /* the keymaps go last, every lookup scans the strings added before */
+    for (size_t i = 0; i < ls->keymapcount; i++) {
+        fm[i].name = strtab_add(&st, ls->keymap_names[i]);
+        fm[i].keymap = strtab_add(&st, kbd_keymap(ls, i));
+    }
+
+    memcpy(h.magic, LAYOUTFILE_MAGIC, sizeof(h.magic));
+    h.version = LAYOUTFILE_VERSION;
+    h.byteorder = LAYOUTFILE_BYTEORDER;
+    h.layoutcount = ls->layoutcount;
+    h.keycount = keycount;
+    h.keymapcount = ls->keymapcount;
+    h.index = ls->index;
+    h.layercount = ls->layercount;
+    h.landscape_layercount = ls->landscape_layercount;
+    for (size_t i = 0; i < ls->layercount && i < MAX_LAYERS; i++)
+        h.layers[i] = ls->layers[i];
+    for (size_t i = 0; i < ls->landscape_layercount && i < MAX_LAYERS; i++)
+        h.landscape_layers[i] = ls->landscape_layers[i];
+    h.layouts_offset = sizeof(h);
+    h.keys_offset = h.layouts_offset + ls->layoutcount * sizeof(*fl);
+    h.keymaps_offset = h.keys_offset + keycount * sizeof(*fk);
+    h.strings_offset = h.keymaps_offset + ls->keymapcount * sizeof(*fm);
+    h.strings_size = st.size;
+    h.size = h.strings_offset + st.size;
+
+    f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        ret = -1;
+        goto out;
+    }
+    if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+        fwrite(fl, sizeof(*fl), ls->layoutcount, f) != ls->layoutcount ||
+        fwrite(fk, sizeof(*fk), keycount, f) != keycount ||
+        fwrite(fm, sizeof(*fm), ls->keymapcount, f) != ls->keymapcount ||
+        fwrite(st.data, 1, st.size, f) != st.size)
+        ret = -1;
+    if (fclose(f) != 0)
+        ret = -1;
+    if (ret < 0)
+        perror(path);
+    else
+        fprintf(stderr, "Wrote %zu layouts, %u keys, %u bytes to %s\n",
+                ls->layoutcount, keycount, h.size, path);
+
+out:
+    free(fl);
+    free(fk);
+    free(fm);
+    free(st.data);
+    return ret;
+}
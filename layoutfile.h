@@ -0,0 +1,78 @@
+#ifndef __LAYOUTFILE_H
+#define __LAYOUTFILE_H
+
+#include <stdint.h>
+#include "keyboard.h"
+
+/* Binary layout files
+ *
+ * A layout file holds a complete layout set (layouts, keys and keymaps) in a
+ * packed, versioned format that is mapped read-only and used in place: labels,
+ * layout names and keymaps are referenced as offsets into a string table at
+ * the end of the file, so every instance using the same file shares its pages
+ * in the page cache. Only the small layout and key arrays that the keyboard
+ * code works on are built on load. Files are written in native byte order
+ * with `--write-layout-file`, which dumps a compiled-in family.
+ *
+ * All offsets are relative to the start of the file.
+ */
+
+#define LAYOUTFILE_MAGIC "WVKBDLYT"
+#define LAYOUTFILE_VERSION 1
+#define LAYOUTFILE_BYTEORDER 0x01020304
+#define LAYOUTFILE_NONE UINT32_MAX // absent string or layout reference
+
+struct layoutfile_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	uint32_t size; // total file size
+
+	uint32_t layoutcount;
+	uint32_t keycount;
+	uint32_t keymapcount;
+	uint32_t index; // layout shown by Cmp + space
+
+	uint32_t layercount, landscape_layercount;
+	uint32_t layers[MAX_LAYERS], landscape_layers[MAX_LAYERS];
+
+	uint32_t layouts_offset; // struct layoutfile_layout[layoutcount]
+	uint32_t keys_offset;    // struct layoutfile_key[keycount]
+	uint32_t keymaps_offset; // struct layoutfile_keymap[keymapcount]
+	uint32_t strings_offset; // NUL terminated strings
+	uint32_t strings_size;
+};
+
+struct layoutfile_layout {
+	uint32_t name; // string, or LAYOUTFILE_NONE for unnamed layouts
+	uint32_t keymap_name;
+	uint32_t first_key; // index into the key array
+	uint32_t keycount;  // including the terminating Last key
+	uint8_t abc;
+	uint8_t pad[3];
+};
+
+struct layoutfile_key {
+	uint32_t label, shift_label;
+	float width;
+	uint32_t code;
+	uint32_t code_mod;
+	uint32_t layout; // layout index, or LAYOUTFILE_NONE
+	uint8_t type;
+	uint8_t scheme;
+	uint8_t reset_mod;
+	uint8_t pad;
+};
+
+struct layoutfile_keymap {
+	uint32_t name;
+	uint32_t keymap;
+};
+
+/* Map a layout file, with the colors and settings of defaults, a compiled-in
+ * family. NULL if it can't be used. */
+struct layoutset *layoutfile_load(const char *path,
+                                  const struct layoutset *defaults);
+int layoutfile_write(struct layoutset *ls, const char *path);
+
+#endif
@@ -0,0 +1,85 @@
+/* A compiled-in layout family. This file is built once per entry of LAYOUTS,
+ * with LAYOUT, KEYMAPS and CONFIG naming its headers and LAYOUTSET the
+ * function that sets it up (see the Makefile).
+ */
+#include <linux/input-event-codes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "keyboard.h"
+#include "keymappack.h"
+
+#if !defined(LAYOUT) || !defined(KEYMAPS) || !defined(CONFIG) ||              \
+    !defined(LAYOUTSET)
+#error "make sure to define LAYOUT, KEYMAPS, CONFIG and LAYOUTSET"
+#endif
+#include LAYOUT
+#include KEYMAPS // packed by tools/packkeymaps.c
+#include CONFIG
+
+/* for configurations predating these */
+#ifndef KBD_KEY_BORDER
+#define KBD_KEY_BORDER 2
+#endif
+#ifndef KBD_REPEAT_DELAY
+#define KBD_REPEAT_DELAY 600
+#endif
+#ifndef KBD_REPEAT_RATE
+#define KBD_REPEAT_RATE 25
+#endif
+#ifndef KBD_LONG_PRESS_DELAY
+#define KBD_LONG_PRESS_DELAY 0
+#endif
+
+#define countof(x) (sizeof(x) / sizeof(*x))
+
+static const char *keymaps[NUMKEYMAPS]; // unpacked on first use
+static const char *combined_keymaps[NUMCOMBINED > 0 ? NUMCOMBINED : 1];
+static size_t layer_indices[countof(layers) - 1];
+static size_t landscape_layer_indices[countof(landscape_layers) - 1];
+
+static struct layoutset layoutset = {
+    .layouts = layouts,
+    .layoutcount = NumLayouts,
+    .index = Index,
+    .keymap_names = keymap_names,
+    .keymaps = keymaps,
+    .keymapcount = NUMKEYMAPS,
+    .pack = &keymap_pack,
+    .combined = combined_keymaps,
+    .combined_groups = keymap_combined_groups,
+    .combinedcount = NUMCOMBINED,
+    .layers = layer_indices,
+    .layercount = countof(layer_indices),
+    .landscape_layers = landscape_layer_indices,
+    .landscape_layercount = countof(landscape_layer_indices),
+    .schemes = schemes,
+    .schemecount = countof(schemes),
+    .content_purpose_layouts = content_purpose_layouts,
+    .height = KBD_PIXEL_HEIGHT,
+    .landscape_height = KBD_PIXEL_LANDSCAPE_HEIGHT,
+    .key_border = KBD_KEY_BORDER,
+    .repeat_delay = KBD_REPEAT_DELAY,
+    .repeat_rate = KBD_REPEAT_RATE,
+    .long_press_delay = KBD_LONG_PRESS_DELAY,
+#ifdef SHIFT_SPACE_IS_TAB
+    .shift_space_is_tab = true,
+#endif
+};
+
+struct layoutset *
+LAYOUTSET(void)
+{
+    // the layers of config.h end with NumLayouts
+    if (!layoutset.name) {
+        for (size_t i = 0; i < countof(layer_indices); i++)
+            layer_indices[i] = layers[i];
+        for (size_t i = 0; i < countof(landscape_layer_indices); i++)
+            landscape_layer_indices[i] = landscape_layers[i];
+        layoutset.name = LAYOUTSET_NAME;
+        if (kbd_layoutset_setup)
+            kbd_layoutset_setup(&layoutset);
+    }
+    return &layoutset;
+}
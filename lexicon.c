@@ -0,0 +1,291 @@
+#include <fcntl.h>
+#include <locale.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wctype.h>
+
+#include "lexicon.h"
+#include "utf8.h"
+
+struct entry {
+    uint32_t cps[LEXICON_WORD_MAX];
+    uint8_t len;
+    uint16_t freq;
+    uint64_t count;
+};
+
+static bool
+lexicon_check(const struct lexicon_header *h)
+{
+    const struct lexicon_node *nodes;
+
+    if (memcmp(h->magic, LEXICON_MAGIC, sizeof(h->magic)) != 0) {
+        fprintf(stderr, "not a lexicon file\n");
+        return false;
+    }
+    if (h->version != LEXICON_VERSION) {
+        fprintf(stderr, "unsupported lexicon version %u\n", h->version);
+        return false;
+    }
+    if (h->byteorder != LEXICON_BYTEORDER) {
+        fprintf(stderr, "lexicon has foreign byte order\n");
+        return false;
+    }
+    if (h->nodes_offset > h->size || h->nodes_offset % 4 ||
+        h->nodecount == 0 ||
+        (uint64_t)h->nodecount * sizeof(struct lexicon_node) >
+            h->size - h->nodes_offset) {
+        fprintf(stderr, "lexicon is truncated or corrupt\n");
+        return false;
+    }
+
+    // children always follow their parent, so every walk terminates
+    nodes = (const void *)((const char *)h + h->nodes_offset);
+    for (uint32_t i = 0; i < h->nodecount; i++) {
+        if (nodes[i].childcount &&
+            (nodes[i].children <= i || nodes[i].children > h->nodecount ||
+             nodes[i].childcount > h->nodecount - nodes[i].children)) {
+            fprintf(stderr, "lexicon has an invalid node %u\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+struct lexicon *
+lexicon_load(const char *path)
+{
+    struct lexicon *lx;
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 ||
+        st.st_size < (off_t)sizeof(struct lexicon_header) ||
+        st.st_size > UINT32_MAX) {
+        fprintf(stderr, "%s: not a lexicon file\n", path);
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+
+    lx = calloc(1, sizeof(*lx));
+    lx->header = map;
+    if (lx->header->size != st.st_size || !lexicon_check(lx->header)) {
+        fprintf(stderr, "%s: could not load lexicon\n", path);
+        munmap(map, st.st_size);
+        free(lx);
+        return NULL;
+    }
+    lx->nodes = (const void *)((const char *)map + lx->header->nodes_offset);
+
+    fprintf(stderr, "Loaded %u words from %s\n", lx->header->wordcount, path);
+    return lx;
+}
+
+const struct lexicon_node *
+lexicon_child(const struct lexicon *lx, const struct lexicon_node *n,
+              uint32_t cp)
+{
+    const struct lexicon_node *c = lx->nodes + n->children;
+    size_t lo = 0, hi = n->childcount;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (c[mid].cp == cp)
+            return &c[mid];
+        if (c[mid].cp < cp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+static int
+entry_cmp(const void *a, const void *b)
+{
+    const struct entry *ea = a, *eb = b;
+    for (size_t i = 0; i < ea->len && i < eb->len; i++) {
+        if (ea->cps[i] != eb->cps[i])
+            return ea->cps[i] < eb->cps[i] ? -1 : 1;
+    }
+    return (int)ea->len - (int)eb->len;
+}
+
+/* Read "word [count]" lines. Words are folded to lower case, as they are
+ * matched against the plain labels of keys. */
+static struct entry *
+lexicon_read(FILE *f, size_t *count)
+{
+    struct entry *entries = NULL;
+    size_t n = 0, cap = 0;
+    bool counted = false;
+    char *line = NULL;
+    size_t linecap = 0;
+
+    while (getline(&line, &linecap, f) > 0) {
+        char *p = line, *end;
+        struct entry e = {0};
+
+        while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+            uint32_t cp;
+            p += utf8_decode(p, &cp);
+            if (e.len == LEXICON_WORD_MAX) {
+                e.len = 0; // too long to ever be typed
+                break;
+            }
+            e.cps[e.len++] = towlower(cp);
+        }
+        if (!e.len)
+            continue;
+        e.count = strtoull(p, &end, 10);
+        if (end != p)
+            counted = true;
+
+        if (n == cap) {
+            cap = cap ? cap * 2 : 4096;
+            entries = realloc(entries, cap * sizeof(*entries));
+        }
+        entries[n++] = e;
+    }
+    free(line);
+
+    // without counts, the list is taken to be ordered from the most frequent
+    if (!counted) {
+        for (size_t i = 0; i < n; i++)
+            entries[i].count = n - i;
+    }
+    *count = n;
+    return entries;
+}
+
+int
+lexicon_write(FILE *in, const char *path)
+{
+    struct lexicon_header h = {0};
+    struct lexicon_node *nodes = NULL;
+    uint32_t *lo = NULL, *hi = NULL, *depth = NULL;
+    size_t n, wordcount = 0, nodecount = 1, cap = 0;
+    uint64_t maxcount = 1;
+    struct entry *entries;
+    FILE *f;
+    int ret = 0;
+
+    setlocale(LC_CTYPE, "C.UTF-8");
+    entries = lexicon_read(in, &n);
+    qsort(entries, n, sizeof(*entries), entry_cmp);
+
+    // merge duplicates, which folding to lower case makes common
+    for (size_t i = 0; i < n; i++) {
+        if (wordcount && !entry_cmp(&entries[wordcount - 1], &entries[i]))
+            entries[wordcount - 1].count += entries[i].count;
+        else
+            entries[wordcount++] = entries[i];
+    }
+    for (size_t i = 0; i < wordcount; i++) {
+        if (entries[i].count > maxcount)
+            maxcount = entries[i].count;
+    }
+    // perceived frequency is logarithmic, and a log scale fits in 16 bits
+    for (size_t i = 0; i < wordcount; i++) {
+        entries[i].freq = 1 + 65534 * (log(entries[i].count + 1) /
+                                       log(maxcount + 1));
+    }
+
+    /* Breadth first, so that the children of each node are consecutive. Each
+     * node covers the range of sorted words it is a prefix of. */
+    cap = 4096;
+    nodes = calloc(cap, sizeof(*nodes));
+    lo = malloc(cap * sizeof(*lo));
+    hi = malloc(cap * sizeof(*hi));
+    depth = malloc(cap * sizeof(*depth));
+    lo[0] = 0;
+    hi[0] = wordcount;
+    depth[0] = 0;
+    for (size_t i = 0; i < nodecount; i++) {
+        uint32_t l = lo[i], d = depth[i];
+
+        if (l < hi[i] && entries[l].len == d)
+            nodes[i].freq = entries[l++].freq;
+        nodes[i].children = nodecount;
+        while (l < hi[i]) {
+            uint32_t cp = entries[l].cps[d], r = l + 1;
+            while (r < hi[i] && entries[r].cps[d] == cp)
+                r++;
+            if (nodes[i].childcount == UINT16_MAX) {
+                fprintf(stderr, "too many different letters, skipping words\n");
+                break;
+            }
+            if (nodecount == cap) {
+                cap *= 2;
+                nodes = realloc(nodes, cap * sizeof(*nodes));
+                lo = realloc(lo, cap * sizeof(*lo));
+                hi = realloc(hi, cap * sizeof(*hi));
+                depth = realloc(depth, cap * sizeof(*depth));
+            }
+            nodes[nodecount] = (struct lexicon_node){.cp = cp};
+            lo[nodecount] = l;
+            hi[nodecount] = r;
+            depth[nodecount] = d + 1;
+            nodecount++;
+            nodes[i].childcount++;
+            l = r;
+        }
+    }
+    // children come after their parents, so this sees them first
+    for (size_t i = nodecount; i-- > 0;) {
+        nodes[i].best = nodes[i].freq;
+        for (uint32_t c = 0; c < nodes[i].childcount; c++) {
+            if (nodes[nodes[i].children + c].best > nodes[i].best)
+                nodes[i].best = nodes[nodes[i].children + c].best;
+        }
+    }
+
+    memcpy(h.magic, LEXICON_MAGIC, sizeof(h.magic));
+    h.version = LEXICON_VERSION;
+    h.byteorder = LEXICON_BYTEORDER;
+    h.nodecount = nodecount;
+    h.wordcount = wordcount;
+    h.nodes_offset = sizeof(h);
+    h.size = h.nodes_offset + nodecount * sizeof(*nodes);
+
+    f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        ret = -1;
+        goto out;
+    }
+    if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+        fwrite(nodes, sizeof(*nodes), nodecount, f) != nodecount)
+        ret = -1;
+    if (fclose(f) != 0)
+        ret = -1;
+    if (ret < 0)
+        perror(path);
+    else
+        fprintf(stderr, "Wrote %zu words, %zu nodes, %u bytes to %s\n",
+                wordcount, nodecount, h.size, path);
+
+out:
+    free(entries);
+    free(nodes);
+    free(lo);
+    free(hi);
+    free(depth);
+    return ret;
+}
@@ -0,0 +1,60 @@
+#ifndef __LEXICON_H
+#define __LEXICON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Lexicon files
+ *
+ * A word list compiled into a trie that is mapped read-only and walked in
+ * place, so loading costs nothing and every instance shares its pages. The
+ * children of a node are consecutive and sorted by code point, and always come
+ * after their parent. Each node records the frequency of the word ending there
+ * and the highest frequency below it, so the most likely completions of a
+ * prefix are found without visiting the whole subtree. Files are written in
+ * native byte order with `--write-lexicon`, from a word list with one word per
+ * line, optionally followed by a space and its count.
+ */
+
+#define LEXICON_MAGIC "WVKBDLEX"
+#define LEXICON_VERSION 1
+#define LEXICON_BYTEORDER 0x01020304
+#define LEXICON_WORD_MAX 48 // longest word in code points
+
+struct lexicon_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	uint32_t size; // total file size
+
+	uint32_t nodecount; // node 0 is the root
+	uint32_t wordcount;
+	uint32_t nodes_offset; // struct lexicon_node[nodecount]
+};
+
+struct lexicon_node {
+	uint32_t cp;         // code point of the edge leading here
+	uint32_t children;   // index of the first child
+	uint16_t childcount;
+	uint16_t freq;       // frequency of the word ending here, 0 if none
+	uint16_t best;       // highest freq in this subtree
+	uint16_t pad;
+};
+
+struct lexicon {
+	const struct lexicon_header *header;
+	const struct lexicon_node *nodes;
+};
+
+struct lexicon *lexicon_load(const char *path);
+/* Compile the word list read from f */
+int lexicon_write(FILE *f, const char *path);
+
+/* The child of a node along the given code point, NULL if there is none */
+const struct lexicon_node *lexicon_child(const struct lexicon *lx,
+                                         const struct lexicon_node *n,
+                                         uint32_t cp);
+
+#endif
@@ -4,21 +4,33 @@
 #include "proto/fractional-scale-v1-client-protocol.h"
 #include "proto/viewporter-client-protocol.h"
 #include "proto/input-method-unstable-v2-protocol.h"
+#include "proto/xdg-output-unstable-v1-client-protocol.h"
 #include <errno.h>
 #include <linux/input-event-codes.h>
+#include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
 #include <wchar.h>
 
 #include "keyboard.h"
-#include "config.h"
+#include "layoutfile.h"
+#include "control.h"
+#include "lexicon.h"
+#include "predict.h"
+#include "settings.h"
+#include "stats.h"
+#include "stream.h"
+#include "swipe.h"
 
 /* lazy die macro */
 #define die(...)                                                               \
@@ -32,6 +44,7 @@
 static const char *namespace = "wvkbd";
 static struct wl_display *display;
 static struct wl_compositor *compositor;
+static struct wl_subcompositor *subcompositor;
 static struct wl_seat *seat;
 static struct wl_pointer *pointer;
 static struct wl_touch *touch;
@@ -48,16 +61,32 @@ static struct wp_fractional_scale_manager_v1 *wfs_mgr;
 static struct wp_viewport *draw_surf_viewport, *popup_draw_surf_viewport;
 static struct wp_viewporter *viewporter;
 static struct zwp_input_method_manager_v2 *im_mgr;
+static struct zxdg_output_manager_v1 *xdg_output_mgr;
 static bool popup_xdg_surface_configured;
 static bool layer_surface_configured;
 
 static uint32_t available_width, available_height = 0;
 static void refresh_available_dimension();
 
+/* outputs, tracked so the available dimensions are known without asking the
+ * compositor each time the keyboard is shown */
+struct output {
+    struct wl_output *wl_output;
+    struct zxdg_output_v1 *xdg_output;
+    uint32_t name; // registry name
+    int32_t mode_width, mode_height; // current mode, in pixels
+    int32_t transform, scale;
+    int32_t logical_width, logical_height; // from xdg-output, 0 if unknown
+    struct output *next;
+};
+static struct output *outputs;
+static struct output *current_output; // output the keyboard was last shown on
+
 /* drawing */
 static struct drw draw_ctx;
 static struct drwbuf draw_surf_back_buffer, draw_surf_display_buffer, popup_draw_surf_back_buffer, popup_draw_surf_display_buffer;
-static struct drwsurf draw_surf, popup_draw_surf;
+static struct drwbuf highlight_surf_back_buffer, highlight_surf_display_buffer;
+static struct drwsurf draw_surf, popup_draw_surf, highlight_surf;
 
 /* layer surface parameters */
 static uint32_t layer = ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY;
@@ -71,10 +100,60 @@ static int cur_x = -1, cur_y = -1;
 static bool cur_press = false;
 static struct kbd keyboard;
 static uint32_t height, normal_height, landscape_height;
-static int rounding = DEFAULT_ROUNDING;
 static bool hidden = false;
+static bool fast_hide = false;
+static bool unmapped = false; // hidden by unmap_surfaces, surfaces kept
+static bool remapping = false; // shown again after unmap_surfaces
 static bool im_auto = false;
 
+/* Layout families, see use_layoutset */
+static struct layoutset *start_layoutset; // shown on narrower outputs
+static struct layoutset *wide_layoutset;  // NULL if not switching by width
+static uint32_t wide_width = 1200; // surface coordinates
+static bool height_given, landscape_height_given; // or taken from the family
+static bool repeat_delay_given, repeat_rate_given, long_press_given;
+static bool rgb565 = false; // asked for 16 bit buffers
+/* Colors and fonts given on the command line, see setup_layoutset */
+static struct settings options = {.alpha = -1, .rounding = -1};
+/* The compiled-in families set up so far, with their schemes as config.h and
+ * the command line make them */
+static struct family {
+    struct layoutset *ls;
+    struct clr_scheme *base;
+} *families;
+static size_t familycount;
+
+/* Config file, see settings.h */
+static const char *config_path;
+static int config_fd = -1; // inotify, -1 if not watched
+static struct settings config = {.alpha = -1, .rounding = -1}; // applied
+/* What the config file replaces, to go back to when a setting is removed */
+static struct {
+    struct layoutset *layoutset; // whose layers the file sets
+    size_t *layers, *landscape_layers;
+    size_t layercount, landscape_layercount;
+    bool height_given, landscape_height_given;
+    uint32_t height, landscape_height;
+} config_base;
+
+/* Input method state is double buffered, it only applies on done */
+static bool im_pending_active;
+static char *im_pending_text; // surrounding text, NULL if it didn't change
+static uint32_t im_pending_cursor;
+static uint32_t im_pending_hint;
+static uint32_t im_pending_purpose;
+static uint32_t im_purpose;
+static struct layout *purpose_layout; // shown for the content purpose
+static bool layout_undrawn; // switched while hidden, the kept frame is stale
+static bool resize_pending; // a new size was asked for the shown surface
+
+/* Content hints of text-input-unstable-v3, passed on by the input method */
+#define CONTENT_HINT_HIDDEN_TEXT 0x40
+#define CONTENT_HINT_SENSITIVE_DATA 0x80
+static bool startup_profile = false;
+static char *stats_file;
+static struct timespec startup_start, startup_last;
+
 /* event handler prototypes */
 static void wl_pointer_enter(void *data, struct wl_pointer *wl_pointer,
                              uint32_t serial, struct wl_surface *surface,
@@ -117,6 +196,30 @@ static void handle_global(void *data, struct wl_registry *registry,
 static void handle_global_remove(void *data, struct wl_registry *registry,
                                  uint32_t name);
 
+static void output_geometry(void *data, struct wl_output *wl_output, int32_t x,
+                            int32_t y, int32_t physical_width,
+                            int32_t physical_height, int32_t subpixel,
+                            const char *make, const char *model,
+                            int32_t transform);
+static void output_mode(void *data, struct wl_output *wl_output,
+                        uint32_t flags, int32_t width, int32_t height,
+                        int32_t refresh);
+static void output_done(void *data, struct wl_output *wl_output);
+static void output_scale(void *data, struct wl_output *wl_output,
+                         int32_t factor);
+static void xdg_output_logical_position(void *data,
+                                        struct zxdg_output_v1 *xdg_output,
+                                        int32_t x, int32_t y);
+static void xdg_output_logical_size(void *data,
+                                    struct zxdg_output_v1 *xdg_output,
+                                    int32_t width, int32_t height);
+static void xdg_output_done(void *data, struct zxdg_output_v1 *xdg_output);
+static void xdg_output_name(void *data, struct zxdg_output_v1 *xdg_output,
+                            const char *name);
+static void xdg_output_description(void *data,
+                                   struct zxdg_output_v1 *xdg_output,
+                                   const char *description);
+
 static void layer_surface_configure(void *data,
                                     struct zwlr_layer_surface_v1 *surface,
                                     uint32_t serial, uint32_t w, uint32_t h);
@@ -133,8 +236,15 @@ static void im_content_type(void *data, struct zwp_input_method_v2 *zwp_input_me
 static void im_done(void *data, struct zwp_input_method_v2 *zwp_input_method_v2);
 static void im_unavailable(void *data, struct zwp_input_method_v2 *zwp_input_method_v2);
 static void redimension_keyboard();
+static struct layoutset *wanted_layoutset(uint32_t width);
+static void apply_scale();
+static void request_resize();
+static void destroy_popup();
+static struct layout *find_layer(const char *name, size_t *layer_index);
 static void show();
+static void profile_phase(const char *phase);
 static void hide();
+static void destroy_surfaces();
 
 /* event handlers */
 static const struct zwp_input_method_v2_listener input_method_listener = {
@@ -174,6 +284,11 @@ void
 wl_surface_enter(void *data, struct wl_surface *wl_surface,
                  struct wl_output *wl_output)
 {
+    struct output *o;
+    for (o = outputs; o; o = o->next) {
+        if (o->wl_output == wl_output)
+            current_output = o;
+    }
 }
 
 void
@@ -185,6 +300,7 @@ void
 wl_preferred_buffer_scale(void *data, struct wl_surface *wl_surface,
                           int scale) {
     keyboard.preferred_scale = scale;
+    apply_scale();
 }
 
 void
@@ -204,6 +320,21 @@ static const struct wl_registry_listener registry_listener = {
     .global_remove = handle_global_remove,
 };
 
+static const struct wl_output_listener output_listener = {
+    .geometry = output_geometry,
+    .mode = output_mode,
+    .done = output_done,
+    .scale = output_scale,
+};
+
+static const struct zxdg_output_v1_listener xdg_output_listener = {
+    .logical_position = xdg_output_logical_position,
+    .logical_size = xdg_output_logical_size,
+    .done = xdg_output_done,
+    .name = xdg_output_name,
+    .description = xdg_output_description,
+};
+
 void
 initiate_configure(void *data, struct zwlr_layer_surface_v1 *surface,
                    uint32_t serial, uint32_t w, uint32_t h)
@@ -252,13 +383,16 @@ wl_touch_down(void *data, struct wl_touch *wl_touch, uint32_t serial,
         return;
     }
 
-    struct key *next_key;
+    const struct key *next_key;
     uint32_t touch_x, touch_y;
 
-    touch_x = wl_fixed_to_int(x);
-    touch_y = wl_fixed_to_int(y);
+    stats_count(StatTouches, 1);
+    touch_x = keyboard.touch_x = wl_fixed_to_int(x);
+    touch_y = keyboard.touch_y = wl_fixed_to_int(y);
 
     kbd_unpress_key(&keyboard, time);
+    if (kbd_press_prediction(&keyboard, touch_x, touch_y, time))
+        return;
 
     next_key = kbd_get_key(&keyboard, touch_x, touch_y);
     if (next_key) {
@@ -291,8 +425,8 @@ wl_touch_motion(void *data, struct wl_touch *wl_touch, uint32_t time,
 
     uint32_t touch_x, touch_y;
 
-    touch_x = wl_fixed_to_int(x);
-    touch_y = wl_fixed_to_int(y);
+    touch_x = keyboard.touch_x = wl_fixed_to_int(x);
+    touch_y = keyboard.touch_y = wl_fixed_to_int(y);
 
     kbd_motion_key(&keyboard, time, touch_x, touch_y);
 }
@@ -341,8 +475,8 @@ wl_pointer_motion(void *data, struct wl_pointer *wl_pointer, uint32_t time,
         return;
     }
 
-    cur_x = wl_fixed_to_int(surface_x);
-    cur_y = wl_fixed_to_int(surface_y);
+    cur_x = keyboard.touch_x = wl_fixed_to_int(surface_x);
+    cur_y = keyboard.touch_y = wl_fixed_to_int(surface_y);
 
     if (cur_press) {
         kbd_motion_key(&keyboard, time, cur_x, cur_y);
@@ -357,16 +491,18 @@ wl_pointer_button(void *data, struct wl_pointer *wl_pointer, uint32_t serial,
         return;
     }
 
-    struct key *next_key;
+    const struct key *next_key;
     cur_press = state == WL_POINTER_BUTTON_STATE_PRESSED;
 
     if (cur_press) {
+        stats_count(StatTouches, 1);
         kbd_unpress_key(&keyboard, time);
     } else {
         kbd_release_key(&keyboard, time);
     }
 
-    if (cur_press && cur_x >= 0 && cur_y >= 0) {
+    if (cur_press && cur_x >= 0 && cur_y >= 0 &&
+        !kbd_press_prediction(&keyboard, cur_x, cur_y, time)) {
         next_key = kbd_get_key(&keyboard, cur_x, cur_y);
         if (next_key) {
             kbd_press_key(&keyboard, next_key, time);
@@ -439,8 +575,12 @@ handle_global(void *data, struct wl_registry *registry, uint32_t name,
     if (strcmp(interface, wl_compositor_interface.name) == 0) {
         compositor =
             wl_registry_bind(registry, name, &wl_compositor_interface, 6);
+    } else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+        subcompositor =
+            wl_registry_bind(registry, name, &wl_subcompositor_interface, 1);
     } else if (strcmp(interface, wl_shm_interface.name) == 0) {
         draw_ctx.shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+        wl_shm_add_listener(draw_ctx.shm, &shm_listener, &draw_ctx);
     } else if (strcmp(interface, wl_seat_interface.name) == 0) {
         seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
         wl_seat_add_listener(seat, &seat_listener, NULL);
@@ -461,14 +601,50 @@ handle_global(void *data, struct wl_registry *registry, uint32_t name,
                       zwp_virtual_keyboard_manager_v1_interface.name) == 0) {
         vkbd_mgr = wl_registry_bind(
             registry, name, &zwp_virtual_keyboard_manager_v1_interface, 1);
-    } else if (im_auto && strcmp(interface, zwp_input_method_manager_v2_interface.name) == 0) {
+    } else if ((im_auto || keyboard.predict) && strcmp(interface, zwp_input_method_manager_v2_interface.name) == 0) {
         im_mgr = wl_registry_bind(registry, name, &zwp_input_method_manager_v2_interface, 1);
+    } else if (strcmp(interface, wl_output_interface.name) == 0) {
+        struct output *o = calloc(1, sizeof(*o));
+        o->name = name;
+        o->scale = 1;
+        o->wl_output = wl_registry_bind(registry, name, &wl_output_interface,
+                                        version < 2 ? version : 2);
+        wl_output_add_listener(o->wl_output, &output_listener, o);
+        if (xdg_output_mgr) {
+            o->xdg_output =
+                zxdg_output_manager_v1_get_xdg_output(xdg_output_mgr, o->wl_output);
+            zxdg_output_v1_add_listener(o->xdg_output, &xdg_output_listener, o);
+        }
+        o->next = outputs;
+        outputs = o;
+    } else if (strcmp(interface, zxdg_output_manager_v1_interface.name) == 0) {
+        xdg_output_mgr = wl_registry_bind(
+            registry, name, &zxdg_output_manager_v1_interface,
+            version < 3 ? version : 3);
+        for (struct output *o = outputs; o; o = o->next) {
+            o->xdg_output =
+                zxdg_output_manager_v1_get_xdg_output(xdg_output_mgr, o->wl_output);
+            zxdg_output_v1_add_listener(o->xdg_output, &xdg_output_listener, o);
+        }
     }
 }
 
 void
 handle_global_remove(void *data, struct wl_registry *registry, uint32_t name)
 {
+    struct output **p, *o;
+    for (p = &outputs; (o = *p); p = &o->next) {
+        if (o->name != name)
+            continue;
+        *p = o->next;
+        if (current_output == o)
+            current_output = NULL;
+        if (o->xdg_output)
+            zxdg_output_v1_destroy(o->xdg_output);
+        wl_output_destroy(o->wl_output);
+        free(o);
+        return;
+    }
 }
 
 static void
@@ -506,6 +682,7 @@ wp_fractional_scale_preferred_scale(
     uint32_t scale)
 {
     keyboard.preferred_fractional_scale = (double)scale / 120;
+    apply_scale();
 }
 
 static const struct wp_fractional_scale_v1_listener
@@ -516,18 +693,151 @@ static const struct wp_fractional_scale_v1_listener
 void
 im_activate(void *data, struct zwp_input_method_v2 *zwp_input_method_v2)
 {
-    show();
+    im_pending_active = true;
+    // a new text field, nothing is known about it until it tells
+    free(im_pending_text);
+    im_pending_text = estrdup("");
+    im_pending_cursor = 0;
+    im_pending_hint = 0;
+    im_pending_purpose = ContentPurposeNormal;
 }
 
 void
 im_deactivate(void *data, struct zwp_input_method_v2 *zwp_input_method_v2)
 {
-    hide();
+    im_pending_active = false;
 }
 
 void
 im_surrounding_text(void *data, struct zwp_input_method_v2 *zwp_input_method_v2,
                     const char *text, uint32_t cursor, uint32_t anchor)
+{
+    free(im_pending_text);
+    im_pending_text = estrdup(text);
+    im_pending_cursor = cursor <= strlen(text) ? cursor : 0;
+}
+
+/* Size of an output in surface coordinates, false if not known yet */
+static bool
+output_dimension(struct output *o, uint32_t *w, uint32_t *h)
+{
+    if (o->logical_width > 0 && o->logical_height > 0) {
+        *w = o->logical_width;
+        *h = o->logical_height;
+        return true;
+    }
+    if (o->mode_width <= 0 || o->mode_height <= 0)
+        return false;
+
+    // odd transforms rotate by 90 or 270 degrees
+    int32_t scale = o->scale > 0 ? o->scale : 1;
+    if (o->transform & 1) {
+        *w = o->mode_height / scale;
+        *h = o->mode_width / scale;
+    } else {
+        *w = o->mode_width / scale;
+        *h = o->mode_height / scale;
+    }
+    return true;
+}
+
+/* Take the available dimensions from the output the keyboard is on, or the
+ * only output there is. Returns false if they can't be known without asking
+ * the compositor. */
+static bool
+update_available_dimension()
+{
+    struct output *o = current_output;
+    if (!o && outputs && !outputs->next)
+        o = outputs;
+    if (!o || !output_dimension(o, &available_width, &available_height))
+        return false;
+    return true;
+}
+
+void
+output_geometry(void *data, struct wl_output *wl_output, int32_t x, int32_t y,
+                int32_t physical_width, int32_t physical_height,
+                int32_t subpixel, const char *make, const char *model,
+                int32_t transform)
+{
+    struct output *o = data;
+    o->transform = transform;
+}
+
+void
+output_mode(void *data, struct wl_output *wl_output, uint32_t flags,
+            int32_t width, int32_t height, int32_t refresh)
+{
+    struct output *o = data;
+    if (flags & WL_OUTPUT_MODE_CURRENT) {
+        o->mode_width = width;
+        o->mode_height = height;
+    }
+}
+
+void
+output_scale(void *data, struct wl_output *wl_output, int32_t factor)
+{
+    struct output *o = data;
+    o->scale = factor;
+}
+
+void
+output_done(void *data, struct wl_output *wl_output)
+{
+    struct output *o = data;
+    uint32_t w, h;
+
+    if (o != current_output || hidden || !layer_surface ||
+        !output_dimension(o, &w, &h))
+        return;
+    if (keyboard.debug)
+        fprintf(stderr, "Output changed to %dx%d\n", w, h);
+
+    // The width follows from the layer surface configure, but switching
+    // between portrait and landscape, or to another layout family, needs a
+    // new height and layout
+    if ((w > h) != keyboard.landscape ||
+        wanted_layoutset(w) != keyboard.layoutset) {
+        if (layer_surface_configured) {
+            request_resize();
+        } else {
+            destroy_surfaces();
+            show();
+        }
+    }
+}
+
+void
+xdg_output_logical_position(void *data, struct zxdg_output_v1 *xdg_output,
+                            int32_t x, int32_t y)
+{
+}
+
+void
+xdg_output_logical_size(void *data, struct zxdg_output_v1 *xdg_output,
+                        int32_t width, int32_t height)
+{
+    struct output *o = data;
+    o->logical_width = width;
+    o->logical_height = height;
+}
+
+void
+xdg_output_done(void *data, struct zxdg_output_v1 *xdg_output)
+{
+}
+
+void
+xdg_output_name(void *data, struct zxdg_output_v1 *xdg_output,
+                const char *name)
+{
+}
+
+void
+xdg_output_description(void *data, struct zxdg_output_v1 *xdg_output,
+                       const char *description)
 {
 }
 
@@ -539,16 +849,155 @@ void im_text_change_cause(void *data, struct zwp_input_method_v2 *zwp_input_meth
 void im_content_type(void *data, struct zwp_input_method_v2 *zwp_input_method_v2,
                      uint32_t hint, uint32_t purpose)
 {
+    im_pending_hint = hint;
+    im_pending_purpose = purpose;
+}
+
+/* Show the layout configured for a content purpose, or go back to the first
+ * layer from one. When the keyboard is being shown, it is drawn before the
+ * surface is mapped, so that the first frame is the right one. */
+static void
+apply_content_purpose(uint32_t purpose)
+{
+    const char *const *names = keyboard.layoutset->content_purpose_layouts;
+    const char *name = purpose < NumContentPurposes ? names[purpose] : NULL;
+    struct layout *l = NULL;
+    size_t layer_index = 0;
+
+    if (name && !(l = find_layer(name, &layer_index)))
+        fprintf(stderr, "No layout %s for content purpose %u\n", name,
+                purpose);
+    if (!l) {
+        // a layout the user switched to is kept
+        if (!purpose_layout || keyboard.layout != purpose_layout) {
+            purpose_layout = NULL;
+            return;
+        }
+        l = &keyboard.layouts[keyboard.landscape ? keyboard.landscape_layers[0]
+                                                 : keyboard.layers[0]];
+    }
+    purpose_layout = name ? l : NULL;
+    if (l == keyboard.layout)
+        return;
+
+    if (keyboard.debug)
+        fprintf(stderr, "Content purpose %u, switching to %s\n", purpose,
+                l->name);
+    if (layer_surface_configured || remapping) {
+        // the buffers are there, a remapped surface shows this frame
+        kbd_switch_layout(&keyboard, l, layer_index);
+    } else {
+        kbd_set_layout(&keyboard, l, layer_index);
+        layout_undrawn = true;
+    }
 }
 
 void
 im_done(void *data, struct zwp_input_method_v2 *zwp_input_method_v2)
 {
+    bool activated = im_pending_active && !keyboard.im_active;
+    bool deactivated = !im_pending_active && keyboard.im_active;
+
+    keyboard.im_serial++;
+    keyboard.im_active = im_pending_active;
+    if (im_auto && activated)
+        show();
+    else if (im_auto && deactivated)
+        hide();
+    if (keyboard.im_active && (activated || im_pending_purpose != im_purpose))
+        apply_content_purpose(im_pending_purpose);
+    im_purpose = im_pending_purpose;
+    // passwords and the like are neither looked at nor completed
+    keyboard.im_sensitive =
+        im_pending_active && (im_pending_hint & (CONTENT_HINT_HIDDEN_TEXT |
+                                                 CONTENT_HINT_SENSITIVE_DATA));
+    if (im_pending_text) {
+        kbd_set_surrounding_text(&keyboard, im_pending_text,
+                                 im_pending_cursor);
+        free(im_pending_text);
+        im_pending_text = NULL;
+    }
 }
 
 void
 im_unavailable(void *data, struct zwp_input_method_v2 *zwp_input_method_v2)
 {
+    fprintf(stderr, "Another input method is active, predictions are "
+                    "typed as keys\n");
+    zwp_input_method_v2_destroy(keyboard.im);
+    keyboard.im = NULL;
+    keyboard.im_active = false;
+}
+
+/* The keyboard surface is opaque if its background and keys are; the popup
+ * surface never is */
+static bool
+schemes_opaque(struct layoutset *ls)
+{
+    for (size_t i = 0; i < ls->schemecount; i++) {
+        struct clr_scheme *scheme = &ls->schemes[i];
+        if (scheme->bg.bgra[3] != 255 || scheme->fg.bgra[3] != 255 ||
+            scheme->high.bgra[3] != 255)
+            return false;
+    }
+    return true;
+}
+
+/* Buffers without an alpha channel if the colors of the family are opaque.
+ * Returns whether they are. */
+static bool
+choose_format(struct layoutset *ls)
+{
+    bool opaque = schemes_opaque(ls);
+    if (!opaque)
+        draw_surf.format = WL_SHM_FORMAT_ARGB8888;
+    else if (rgb565 && draw_ctx.rgb565)
+        draw_surf.format = WL_SHM_FORMAT_RGB565;
+    else
+        draw_surf.format = WL_SHM_FORMAT_XRGB8888;
+    return opaque;
+}
+
+/* Load the fonts of a layout family's schemes, once */
+static void
+load_fonts(struct layoutset *ls)
+{
+    for (size_t i = 0; i < ls->schemecount; i++) {
+        if (ls->schemes[i].font_description)
+            continue;
+        ls->schemes[i].font_description =
+            pango_font_description_from_string(ls->schemes[i].font);
+        drw_preload_font(ls->schemes[i].font_description);
+    }
+}
+
+/* Take the colors and settings of a layout family, those given on the command
+ * line or by the environment aside */
+static void
+use_layoutset(struct layoutset *ls)
+{
+    keyboard.schemes = ls->schemes;
+    // buffers made from now on, as when resizing for the new family
+    choose_format(ls);
+    if (!height_given)
+        normal_height = ls->height;
+    if (!landscape_height_given)
+        landscape_height = ls->landscape_height;
+    if (!repeat_delay_given)
+        keyboard.repeat_delay = ls->repeat_delay;
+    if (!repeat_rate_given)
+        keyboard.repeat_rate = ls->repeat_rate;
+    if (!long_press_given)
+        keyboard.long_press_delay = ls->long_press_delay;
+}
+
+/* The layout family for an output that wide */
+static struct layoutset *
+wanted_layoutset(uint32_t width)
+{
+    if (wide_layoutset && width >= wide_width)
+        return wide_layoutset;
+    return start_layoutset;
 }
 
 void
@@ -556,7 +1005,14 @@ redimension_keyboard()
 {
     keyboard.landscape = available_width > available_height;
 
-    enum layout_id layer;
+    struct layoutset *ls = wanted_layoutset(available_width);
+    if (ls != keyboard.layoutset) {
+        use_layoutset(ls);
+        load_fonts(ls);
+        kbd_set_layoutset(&keyboard, ls);
+    }
+
+    size_t layer;
     if (keyboard.landscape) {
         layer = keyboard.landscape_layers[0];
         height = landscape_height;
@@ -574,45 +1030,57 @@ redimension_keyboard()
     keyboard.last_abc_index = 0;
 }
 
-void
-layer_surface_configure(void *data, struct zwlr_layer_surface_v1 *surface,
-                        uint32_t serial, uint32_t w, uint32_t h)
+/* The preferred scale changed while shown, e.g. the keyboard moved to another
+ * output. The size in surface coordinates is the same, so only the buffers are
+ * replaced: the layout is painted at the new scale into new buffers, which are
+ * committed along with the new buffer scale, so the old frame stays up until
+ * the new one replaces it. Before the first configure, it just applies there.
+ */
+static void
+apply_scale()
 {
-    // Swallow events for old/destroyed surface
-    if (surface != layer_surface) {
-        zwlr_layer_surface_v1_ack_configure(surface, serial);
-        return;
-    };
-
-    // Not what we expected, or redimension, refresh and restart
-    if (keyboard.w != w || keyboard.h != h) {
-        zwlr_layer_surface_v1_ack_configure(surface, serial);
-        hide();
-        show();
-        return;
-    };
-
-    // Swallow useless events
-    if (layer_surface_configured) {
-        return;
-    };
-    layer_surface_configured = true;
-
     double scale = keyboard.preferred_scale;
     if (keyboard.preferred_fractional_scale) {
         scale = keyboard.preferred_fractional_scale;
     }
+    if (!layer_surface_configured || scale == keyboard.scale)
+        return;
 
     keyboard.scale = scale;
-    hidden = false;
-
-    if (wfs_mgr && viewporter) {
-        wp_viewport_set_destination(draw_surf_viewport, keyboard.w,
-                                    keyboard.h);
-    } else {
+    if (!(wfs_mgr && viewporter)) {
         wl_surface_set_buffer_scale(draw_surf.surf, keyboard.scale);
+        if (popup_draw_surf.surf)
+            wl_surface_set_buffer_scale(popup_draw_surf.surf, keyboard.scale);
+    }
+    kbd_rescale(&keyboard);
+    wl_surface_damage(draw_surf.surf, 0, 0, keyboard.w, keyboard.h);
+    drwsurf_attach(&draw_surf);
+    if (popup_draw_surf.attached) {
+        wl_surface_damage(popup_draw_surf.surf, 0, 0, keyboard.w,
+                          keyboard.h * 2);
+        drwsurf_attach(&popup_draw_surf);
+    }
+}
+
+/* Let the compositor skip blending what is below an opaque keyboard, and
+ * blend it again once the keyboard has alpha */
+static void
+set_opaque_region(uint32_t w, uint32_t h)
+{
+    if (draw_surf.format == WL_SHM_FORMAT_ARGB8888) {
+        wl_surface_set_opaque_region(draw_surf.surf, NULL);
+        return;
     }
+    struct wl_region *region = wl_compositor_create_region(compositor);
+    wl_region_add(region, 0, 0, w, h);
+    wl_surface_set_opaque_region(draw_surf.surf, region);
+    wl_region_destroy(region);
+}
 
+/* The popup covers the keyboard and as much above it */
+static void
+create_popup(uint32_t w, uint32_t h)
+{
     popup_draw_surf.surf = wl_compositor_create_surface(compositor);
 
     xdg_positioner_set_size(popup_xdg_positioner, w, h * 2);
@@ -634,11 +1102,162 @@ layer_surface_configure(void *data, struct zwlr_layer_surface_v1 *surface,
     }
 
     wl_surface_commit(popup_draw_surf.surf);
+}
+
+/* The subsurface key presses are shown on, above the keyboard surface. It is
+ * unsynchronized, so that it updates without committing the keyboard. */
+static void
+create_highlight()
+{
+    if (!subcompositor || !keyboard.show_highlight)
+        return;
+    highlight_surf.surf = wl_compositor_create_surface(compositor);
+    wl_surface_set_input_region(highlight_surf.surf, empty_region);
+    keyboard.highlight_sub = wl_subcompositor_get_subsurface(
+        subcompositor, highlight_surf.surf, draw_surf.surf);
+    wl_subsurface_set_desync(keyboard.highlight_sub);
+    if (wfs_mgr && viewporter) {
+        keyboard.highlight_viewport =
+            wp_viewporter_get_viewport(viewporter, highlight_surf.surf);
+    }
+    // sized at the first press
+    highlight_surf.scale = 0;
+    keyboard.highlighted = NULL;
+}
+
+static void
+destroy_highlight()
+{
+    if (!keyboard.highlight_sub)
+        return;
+    if (keyboard.highlight_viewport) {
+        wp_viewport_destroy(keyboard.highlight_viewport);
+        keyboard.highlight_viewport = NULL;
+    }
+    if (highlight_surf.frame_cb) {
+        wl_callback_destroy(highlight_surf.frame_cb);
+        highlight_surf.frame_cb = NULL;
+    }
+    wl_subsurface_destroy(keyboard.highlight_sub);
+    keyboard.highlight_sub = NULL;
+    wl_surface_destroy(highlight_surf.surf);
+    highlight_surf.surf = NULL;
+    highlight_surf.attached = false;
+    keyboard.highlighted = NULL;
+}
+
+/* Ask for the height of the current orientation, and its first layer. The
+ * surfaces are kept and resized in place when the compositor configures the
+ * new size. */
+static void
+request_resize()
+{
+    update_available_dimension();
+    redimension_keyboard();
+    resize_pending = true;
+    zwlr_layer_surface_v1_set_size(layer_surface, 0, height);
+    if (keyboard.exclusive) {
+        zwlr_layer_surface_v1_set_exclusive_zone(layer_surface, height);
+    }
+    wl_surface_commit(draw_surf.surf);
+}
+
+/* A shown surface got a new size: lay out and draw again into resized
+ * buffers. The popup can't be repositioned with xdg_wm_base version 1, it is
+ * made anew. */
+static void
+resize_surfaces(struct zwlr_layer_surface_v1 *surface, uint32_t serial,
+                uint32_t w, uint32_t h)
+{
+    if (keyboard.debug)
+        fprintf(stderr, "Resizing in place to %dx%d\n", w, h);
+    zwlr_layer_surface_v1_ack_configure(surface, serial);
+    resize_pending = false;
+    keyboard.w = available_width = w;
+    keyboard.h = h;
+    if (draw_surf_viewport) {
+        wp_viewport_set_destination(draw_surf_viewport, w, h);
+    }
+    set_opaque_region(w, h);
+    destroy_popup();
+    create_popup(w, h);
+
+    kbd_resize(&keyboard);
+    wl_surface_damage(draw_surf.surf, 0, 0, w, h);
+    drwsurf_attach(&draw_surf);
+    layout_undrawn = false;
+}
+
+void
+layer_surface_configure(void *data, struct zwlr_layer_surface_v1 *surface,
+                        uint32_t serial, uint32_t w, uint32_t h)
+{
+    // Swallow events for old/destroyed surface, or one hidden again before
+    // it was mapped
+    if (surface != layer_surface || unmapped) {
+        zwlr_layer_surface_v1_ack_configure(surface, serial);
+        return;
+    };
+
+    // Already shown: keep the surfaces, resize them if needed
+    if (layer_surface_configured) {
+        if (resize_pending || keyboard.w != w || keyboard.h != h)
+            resize_surfaces(surface, serial, w, h);
+        return;
+    }
+
+    // The width of a new surface is up to the compositor, as it depends on
+    // the output and on exclusive zones of other surfaces: take it
+    if (keyboard.h == h) {
+        keyboard.w = available_width = w;
+    }
+
+    // Not what we expected, refresh and restart
+    if (keyboard.w != w || keyboard.h != h) {
+        zwlr_layer_surface_v1_ack_configure(surface, serial);
+        destroy_surfaces();
+        show();
+        return;
+    };
+    layer_surface_configured = true;
+
+    double scale = keyboard.preferred_scale;
+    if (keyboard.preferred_fractional_scale) {
+        scale = keyboard.preferred_fractional_scale;
+    }
+
+    keyboard.scale = scale;
+    hidden = false;
+
+    if (wfs_mgr && viewporter) {
+        wp_viewport_set_destination(draw_surf_viewport, keyboard.w,
+                                    keyboard.h);
+    } else {
+        wl_surface_set_buffer_scale(draw_surf.surf, keyboard.scale);
+    }
+
+    create_popup(w, h);
+    create_highlight();
+    set_opaque_region(w, h);
 
     zwlr_layer_surface_v1_ack_configure(surface, serial);
 
-    kbd_resize(&keyboard, layouts, NumLayouts);
+    // Mapped again after unmap_surfaces: the last frame is still good
+    bool remapped = remapping;
+    remapping = false;
+    if (remapped && !layout_undrawn && draw_surf.width == ceil(w * scale) &&
+        draw_surf.height == ceil(h * scale) && draw_surf.scale == scale) {
+        wl_surface_damage(draw_surf.surf, 0, 0, w, h);
+        drwsurf_attach(&draw_surf);
+        return;
+    }
+
+    kbd_resize(&keyboard);
     drwsurf_attach(&draw_surf);
+    layout_undrawn = false;
+
+    profile_phase("first frame");
+    startup_profile = false;
 }
 
 void
@@ -649,6 +1268,54 @@ layer_surface_closed(void *data, struct zwlr_layer_surface_v1 *surface)
     run_display = false;
 }
 
+/* Report the time spent in a startup phase, with --startup-profile */
+static void
+profile_phase(const char *phase)
+{
+    struct timespec now;
+    if (!startup_profile)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(stderr, "startup: %-28s %8.3f ms (total %8.3f ms)\n", phase,
+            (now.tv_sec - startup_last.tv_sec) * 1e3 +
+                (now.tv_nsec - startup_last.tv_nsec) / 1e6,
+            (now.tv_sec - startup_start.tv_sec) * 1e3 +
+                (now.tv_nsec - startup_start.tv_nsec) / 1e6);
+    startup_last = now;
+}
+
+static void
+roundtrip_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+    *(bool *)data = true;
+    wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener roundtrip_listener = {
+    .done = roundtrip_done,
+};
+
+/* A roundtrip split in two, so that local work can be done while the
+ * compositor processes the requests sent so far */
+static void
+start_roundtrip(bool *done)
+{
+    *done = false;
+    struct wl_callback *callback = wl_display_sync(display);
+    wl_callback_add_listener(callback, &roundtrip_listener, done);
+    wl_display_flush(display);
+}
+
+static void
+finish_roundtrip(bool *done)
+{
+    while (!*done) {
+        if (wl_display_dispatch(display) == -1) {
+            die("Failed to dispatch wayland events: %d\n", errno);
+        }
+    }
+}
+
 void
 usage(char *argv0)
 {
@@ -661,11 +1328,15 @@ usage(char *argv0)
     fprintf(stderr, "  -o          - Print pressed keys to standard output\n");
     fprintf(stderr,
             "  -O          - Print intersected keys to standard output\n");
+    fprintf(stderr, "  --output-format [text|json|binary] - Format of -o "
+                    "and -O output\n");
     fprintf(stderr, "  -H [int]    - Height in pixels\n");
     fprintf(stderr, "  -L [int]    - Landscape height in pixels\n");
     fprintf(stderr, "  -R [int]    - Rounding radius in pixels\n");
     fprintf(stderr, "  --fn [font] - Set font (e.g: DejaVu Sans 20)\n");
     fprintf(stderr, "  --hidden    - Start hidden (send SIGUSR2 to show)\n");
+    fprintf(stderr, "  --fast-hide - Keep the surfaces when hidden, only "
+                    "unmap them\n");
     fprintf(stderr, "  --no-popup             - Disable the key-press popup\n");
     fprintf(stderr, "  --no-highlight         - Don't highlight a key while pressed\n");
     fprintf(stderr, "  --no-feedback          - Disable all key-press feedback "
@@ -673,6 +1344,8 @@ usage(char *argv0)
     fprintf(
         stderr,
         "  --alpha [int]          - Set alpha value for all colors [0-255]\n");
+    fprintf(stderr, "  --rgb565           - Use 16 bit buffers, if the colors "
+                    "are opaque\n");
     fprintf(stderr, "  --auto                 - Automatically toggle visibility based on focus\n");
     fprintf(stderr, "  --bg [rrggbb|aa]       - Set color of background\n");
     fprintf(stderr, "  --fg [rrggbb|aa]       - Set color of keys\n");
@@ -700,36 +1373,58 @@ usage(char *argv0)
             "  -l                 - Comma separated list of layers\n");
     fprintf(stderr, "  --landscape-layers - Comma separated list of "
                     "landscape layers\n");
+    fprintf(stderr, "  --layoutset [name]      - Layout family to use (e.g: "
+                    "mobintl, deskintl)\n");
+    fprintf(stderr, "  --wide-layoutset [name] - Layout family to use on "
+                    "wider outputs\n");
+    fprintf(stderr, "  --wide-width [int]      - Width from which an output "
+                    "is wide, default 1200\n");
     fprintf(stderr, "  --non-exclusive    - Allow the keyboard to overlap"
                     " windows. Do not request an exclusive zone from the"
                     "compositor\n");
+    fprintf(stderr, "  --layout-file [path]       - Load layouts and keymaps "
+                    "from a binary layout file\n");
+    fprintf(stderr, "  --write-layout-file [path] - Write the compiled-in "
+                    "layouts to a binary layout file\n");
+    fprintf(stderr, "  --lexicon [path]   - Type words by swiping over their "
+                    "letters, using this lexicon\n");
+    fprintf(stderr, "  --predict          - Show completions of the word "
+                    "being typed, from the lexicon\n");
+    fprintf(stderr, "  --write-lexicon [path] - Compile the word list read "
+                    "from standard input into a lexicon\n");
+    fprintf(stderr, "  --repeat-delay [ms]  - Delay before a held key "
+                    "repeats\n");
+    fprintf(stderr, "  --repeat-rate [int]  - Repeats per second, 0 to "
+                    "disable repeat\n");
+    fprintf(stderr, "  --long-press [ms]  - Hold a key this long to choose "
+                    "from its alternates, 0 to disable\n");
+    fprintf(stderr, "  --socket [path]    - Accept commands on a control "
+                    "socket\n");
+    fprintf(stderr, "  --config [path]    - Read settings from this file "
+                    "and apply its changes live\n");
+    fprintf(stderr, "  --stats-file [path] - Write statistics there instead "
+                    "of standard error\n");
+    fprintf(stderr, "  --startup-profile  - Print the time spent in each "
+                    "startup phase\n");
 }
 
 void
-list_layers()
+list_layers(struct layoutset *ls)
 {
-    int i;
-    for (i = 0; i < NumLayouts - 1; i++) {
-        if (layouts[i].name) {
-            puts(layouts[i].name);
+    size_t i;
+    for (i = 0; i < ls->layoutcount; i++) {
+        if (i != ls->index && ls->layouts[i].name) {
+            puts(ls->layouts[i].name);
         }
     }
 }
 
-void
-hide()
+static void
+destroy_popup()
 {
-    if (!layer_surface) {
-        return;
-    }
-
-    if (wfs_draw_surf) {
-        wp_fractional_scale_v1_destroy(wfs_draw_surf);
-        wfs_draw_surf = NULL;
-    }
-    if (draw_surf_viewport) {
-        wp_viewport_destroy(draw_surf_viewport);
-        draw_surf_viewport = NULL;
+    if (popup_draw_surf_viewport) {
+        wp_viewport_destroy(popup_draw_surf_viewport);
+        popup_draw_surf_viewport = NULL;
     }
     if (popup_xdg_popup) {
         xdg_popup_destroy(popup_xdg_popup);
@@ -739,14 +1434,39 @@ hide()
         xdg_surface_destroy(popup_xdg_surface);
         popup_xdg_surface = NULL;
     }
+    if (popup_draw_surf.frame_cb) {
+        wl_callback_destroy(popup_draw_surf.frame_cb);
+        popup_draw_surf.frame_cb = NULL;
+    }
     if (popup_draw_surf.surf) {
         wl_surface_destroy(popup_draw_surf.surf);
         popup_draw_surf.surf = NULL;
     }
+    popup_draw_surf.attached = false;
+}
+
+/* Destroy the keyboard surfaces, show() creates them anew */
+static void
+destroy_surfaces()
+{
+    if (!layer_surface) {
+        return;
+    }
+
+    if (wfs_draw_surf) {
+        wp_fractional_scale_v1_destroy(wfs_draw_surf);
+        wfs_draw_surf = NULL;
+    }
+    if (draw_surf_viewport) {
+        wp_viewport_destroy(draw_surf_viewport);
+        draw_surf_viewport = NULL;
+    }
+    destroy_popup();
 
     zwlr_layer_surface_v1_destroy(layer_surface);
     layer_surface = NULL;
     layer_surface_configured = false;
+    unmapped = remapping = false;
 
     // Cancel pending frame callback before destroying surface
     if (draw_surf.frame_cb) {
@@ -754,20 +1474,78 @@ hide()
         draw_surf.frame_cb = NULL;
     }
 
+    destroy_highlight();
     wl_surface_destroy(draw_surf.surf);
     draw_surf.attached = false;
 
     hidden = true;
 }
 
+/* Unmap the layer surface by attaching no buffer, keeping it and its buffers
+ * around so that show() only has to map it again */
+static void
+unmap_surfaces()
+{
+    if (!layer_surface || unmapped) {
+        return;
+    }
+
+    destroy_popup();
+
+    if (draw_surf.frame_cb) {
+        wl_callback_destroy(draw_surf.frame_cb);
+        draw_surf.frame_cb = NULL;
+    }
+    if (keyboard.exclusive) {
+        zwlr_layer_surface_v1_set_exclusive_zone(layer_surface, 0);
+    }
+    wl_surface_attach(draw_surf.surf, NULL, 0, 0);
+    wl_surface_commit(draw_surf.surf);
+    draw_surf.attached = false;
+
+    // an unmapped layer surface is configured again when it is mapped
+    layer_surface_configured = false;
+    unmapped = true;
+    hidden = true;
+}
+
+void
+hide()
+{
+    if (fast_hide)
+        unmap_surfaces();
+    else
+        destroy_surfaces();
+}
+
 void
 show()
 {
+    if (unmapped) {
+        // Map the surface again, unless a rotation while hidden asks for
+        // another layout
+        if (!update_available_dimension() ||
+            ((available_width > available_height) == keyboard.landscape &&
+             wanted_layoutset(available_width) == keyboard.layoutset)) {
+            if (keyboard.exclusive) {
+                zwlr_layer_surface_v1_set_exclusive_zone(layer_surface,
+                                                         height);
+            }
+            wl_surface_commit(draw_surf.surf);
+            unmapped = false;
+            remapping = true;
+            return;
+        }
+        destroy_surfaces();
+    }
+
     if (layer_surface) {
         return;
     }
 
-    refresh_available_dimension();
+    // Only ask the compositor when the outputs don't tell
+    if (!update_available_dimension())
+        refresh_available_dimension();
     redimension_keyboard();
 
     draw_surf.surf = wl_compositor_create_surface(compositor);
@@ -807,6 +1585,165 @@ toggle_visibility()
         hide();
 }
 
+/* Write the statistics to the --stats-file, or standard error */
+static void
+dump_stats()
+{
+    FILE *f = stderr;
+    if (stats_file && !(f = fopen(stats_file, "w"))) {
+        perror(stats_file);
+        return;
+    }
+    stats_write_json(f, true);
+    if (f != stderr)
+        fclose(f);
+}
+
+/* The layout given by name and its layer index, preferring its place in the
+ * layers. NULL if there is none. */
+static struct layout *
+find_layer(const char *name, size_t *layer_index)
+{
+    size_t *layers = keyboard.landscape ? keyboard.landscape_layers
+                                        : keyboard.layers;
+    size_t layercount = keyboard.landscape ? keyboard.landscape_layercount
+                                           : keyboard.layercount;
+    struct layout *l;
+
+    for (size_t i = 0; i < layercount; i++) {
+        l = &keyboard.layouts[layers[i]];
+        if (l->name && !strcmp(l->name, name)) {
+            *layer_index = i;
+            return l;
+        }
+    }
+    for (size_t i = 0; i < keyboard.layoutset->layoutcount; i++) {
+        l = &keyboard.layouts[i];
+        if (i != keyboard.layoutset->index && l->name &&
+            !strcmp(l->name, name)) {
+            *layer_index = kbd_get_layer_index(&keyboard, l);
+            return l;
+        }
+    }
+    return NULL;
+}
+
+/* Show the layout given by name */
+static bool
+switch_layer(const char *name)
+{
+    size_t layer_index;
+    struct layout *l = find_layer(name, &layer_index);
+
+    if (!l)
+        return false;
+    kbd_switch_layout(&keyboard, l, layer_index);
+    return true;
+}
+
+/* Make the surfaces anew, shown unless hidden */
+static void
+recreate_surfaces()
+{
+    bool shown = !unmapped;
+    destroy_surfaces();
+    if (shown)
+        show();
+}
+
+static void
+control_command(struct control_client *c, const char *cmd, const char *arg)
+{
+    if (!strcmp(cmd, "show")) {
+        show();
+        control_reply(c, "ok");
+    } else if (!strcmp(cmd, "hide")) {
+        hide();
+        control_reply(c, "ok");
+    } else if (!strcmp(cmd, "toggle")) {
+        toggle_visibility();
+        control_reply(c, "ok");
+    } else if (!strcmp(cmd, "layer")) {
+        // the layout is reset to the first layer when shown
+        if (hidden || !layer_surface_configured)
+            control_reply(c, "error keyboard is hidden");
+        else if (!*arg)
+            control_reply(c, "error missing layer name");
+        else if (!switch_layer(arg))
+            control_reply(c, "error no such layer: %s", arg);
+        else
+            control_reply(c, "ok");
+    } else if (!strcmp(cmd, "height")) {
+        char *end;
+        long h = strtol(arg, &end, 10);
+        if (!*arg || *end || h <= 0 || h > UINT16_MAX) {
+            control_reply(c, "error invalid height: %s", arg);
+            return;
+        }
+        if (keyboard.landscape) {
+            landscape_height = h;
+            landscape_height_given = true;
+        } else {
+            normal_height = h;
+            height_given = true;
+        }
+        if (layer_surface_configured) {
+            request_resize();
+        } else if (layer_surface) {
+            // recreate the surfaces at the new height
+            recreate_surfaces();
+        }
+        control_reply(c, "ok");
+    } else if (!strcmp(cmd, "layoutset")) {
+        struct layoutset *ls = kbd_builtin_layoutset(arg);
+        if (!ls) {
+            control_reply(c, "error no such layout family: %s", arg);
+            return;
+        }
+        // chosen over the one for the output width
+        start_layoutset = ls;
+        wide_layoutset = NULL;
+        if (layer_surface_configured) {
+            request_resize();
+        } else if (layer_surface) {
+            recreate_surfaces();
+        }
+        control_reply(c, "ok");
+    } else if (!strcmp(cmd, "query")) {
+        control_reply(c, "ok visible=%d landscape=%d height=%u layoutset=%s "
+                         "layout=%s layer=%zu mods=%u compose=%u",
+                      !hidden, keyboard.landscape, keyboard.h,
+                      keyboard.layoutset->name ? keyboard.layoutset->name : "",
+                      keyboard.layout->name ? keyboard.layout->name : "",
+                      keyboard.layer_index, keyboard.mods, keyboard.compose);
+    } else if (!strcmp(cmd, "stats")) {
+        if (!strcmp(arg, "dump")) {
+            dump_stats();
+            control_reply(c, "ok");
+        } else if (!strcmp(arg, "reset")) {
+            stats_reset();
+            control_reply(c, "ok");
+        } else if (!*arg) {
+            char *json = NULL;
+            size_t len;
+            FILE *f = open_memstream(&json, &len);
+            if (!f) {
+                control_reply(c, "error %s", strerror(errno));
+                return;
+            }
+            stats_write_json(f, false);
+            fclose(f);
+            json[strcspn(json, "\n")] = '\0';
+            control_reply(c, "ok %s", json);
+            free(json);
+        } else {
+            control_reply(c, "error unknown stats command: %s", arg);
+        }
+    } else {
+        control_reply(c, "error unknown command: %s", cmd);
+    }
+}
+
 void
 pipewarn()
 {
@@ -833,6 +1770,217 @@ set_kbd_colors(uint8_t *bgra, char *hex)
     }
 }
 
+/* Set a color of a scheme for every compiled-in layout family */
+static void
+set_scheme_colors(size_t scheme, size_t offset, char *hex)
+{
+    for (size_t c = 0; c < SETTINGS_COLORS; c++) {
+        if (settings_colors[c].scheme == scheme &&
+            settings_colors[c].offset == offset)
+            options.colors[c] = hex;
+    }
+}
+
+/* Give scheme i the colors, alpha, rounding and font of s */
+static void
+override_scheme(struct clr_scheme *scheme, size_t i, const struct settings *s)
+{
+    for (size_t c = 0; c < SETTINGS_COLORS; c++) {
+        if (s->colors[c] && settings_colors[c].scheme == i)
+            set_kbd_colors((uint8_t *)scheme + settings_colors[c].offset,
+                           s->colors[c]);
+    }
+    if (s->alpha >= 0) {
+        scheme->bg.bgra[3] = s->alpha;
+        scheme->fg.bgra[3] = s->alpha;
+        scheme->high.bgra[3] = s->alpha;
+    }
+    if (s->rounding >= 0)
+        scheme->rounding = s->rounding;
+    if (s->font)
+        scheme->font = s->font;
+}
+
+/* A compiled-in family is used for the first time: the command line and then
+ * the config file go over its config.h */
+static void
+setup_layoutset(struct layoutset *ls)
+{
+    for (size_t i = 0; i < ls->schemecount; i++)
+        override_scheme(&ls->schemes[i], i, &options);
+
+    families = realloc(families, (familycount + 1) * sizeof(*families));
+    struct family *f = &families[familycount++];
+    size_t size = ls->schemecount * sizeof(struct clr_scheme);
+    f->ls = ls;
+    f->base = malloc(size);
+    memcpy(f->base, ls->schemes, size);
+
+    for (size_t i = 0; i < ls->schemecount; i++)
+        override_scheme(&ls->schemes[i], i, &config);
+}
+
+static bool
+same_colors(const struct clr_scheme *a, const struct clr_scheme *b)
+{
+    return a->fg.color == b->fg.color && a->bg.color == b->bg.color &&
+           a->high.color == b->high.color && a->swipe.color == b->swipe.color &&
+           a->text.color == b->text.color &&
+           a->text_press.color == b->text_press.color &&
+           a->text_swipe.color == b->text_swipe.color &&
+           a->rounding == b->rounding;
+}
+
+static bool
+same_string(const char *a, const char *b)
+{
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+/* Keep what the config file replaces, before it is first applied */
+static void
+take_config_base()
+{
+    config_base.layoutset = start_layoutset;
+    config_base.layers = start_layoutset->layers;
+    config_base.layercount = start_layoutset->layercount;
+    config_base.landscape_layers = start_layoutset->landscape_layers;
+    config_base.landscape_layercount = start_layoutset->landscape_layercount;
+    config_base.height_given = height_given;
+    config_base.landscape_height_given = landscape_height_given;
+    config_base.height = normal_height;
+    config_base.landscape_height = landscape_height;
+}
+
+/* Replace a layer sequence by the layers named, or by base without names.
+ * The sequence stays if a name is wrong. */
+static void
+replace_layers(const char *names, size_t **layers, size_t *count,
+               size_t *base, size_t basecount)
+{
+    struct layoutset *ls = config_base.layoutset;
+    size_t *replacement = base, n = basecount;
+
+    if (names) {
+        char *list = estrdup(names);
+        replacement = kbd_init_layers(ls, list, &n);
+        free(list);
+        if (!replacement)
+            return;
+    }
+    if (*layers != base)
+        free(*layers);
+    *layers = replacement;
+    *count = n;
+}
+
+/* Apply the settings of the config file that changed since it was last
+ * applied, redoing only what they affect: new colors are painted, new fonts
+ * measured, new heights laid out and new layers only replace the layer
+ * sequences. Takes the settings over. */
+static void
+apply_config(struct settings *s)
+{
+    bool repaint = false, reshape = false, resize = false;
+
+    if (!config_base.layoutset)
+        take_config_base();
+
+    // families not set up yet take the settings when they are
+    for (size_t f = 0; f < familycount; f++) {
+        struct layoutset *ls = families[f].ls;
+        bool shown = keyboard.schemes == ls->schemes;
+        for (size_t i = 0; i < ls->schemecount; i++) {
+            struct clr_scheme *scheme = &ls->schemes[i];
+            struct clr_scheme want = families[f].base[i];
+            override_scheme(&want, i, s);
+
+            // the old string goes with the old settings
+            bool new_font = strcmp(scheme->font, want.font);
+            want.font_description = scheme->font_description;
+            if (!same_colors(&want, scheme))
+                repaint |= shown;
+            *scheme = want;
+            if (new_font && scheme->font_description) {
+                pango_font_description_free(scheme->font_description);
+                scheme->font_description =
+                    pango_font_description_from_string(scheme->font);
+                reshape |= shown;
+            }
+        }
+    }
+
+    if (s->height != config.height) {
+        height_given = s->height || config_base.height_given;
+        normal_height = s->height               ? s->height
+                        : config_base.height_given ? config_base.height
+                                                   : keyboard.layoutset->height;
+        resize |= !keyboard.landscape;
+    }
+    if (s->landscape_height != config.landscape_height) {
+        landscape_height_given =
+            s->landscape_height || config_base.landscape_height_given;
+        landscape_height = s->landscape_height ? s->landscape_height
+                           : config_base.landscape_height_given
+                               ? config_base.landscape_height
+                               : keyboard.layoutset->landscape_height;
+        resize |= keyboard.landscape;
+    }
+
+    struct layoutset *ls = config_base.layoutset;
+    if (!same_string(s->layers, config.layers)) {
+        replace_layers(s->layers, &ls->layers, &ls->layercount,
+                       config_base.layers, config_base.layercount);
+    }
+    if (!same_string(s->landscape_layers, config.landscape_layers)) {
+        replace_layers(s->landscape_layers, &ls->landscape_layers,
+                       &ls->landscape_layercount, config_base.landscape_layers,
+                       config_base.landscape_layercount);
+    }
+    if (keyboard.layoutset == ls)
+        kbd_update_layers(&keyboard);
+
+    settings_free(&config);
+    config = *s;
+
+    if (reshape)
+        kbd_reshape(&keyboard);
+    // surfaces made later take the format chosen now
+    uint32_t format = draw_surf.format;
+    if (repaint)
+        choose_format(keyboard.layoutset);
+    bool format_changed = format != draw_surf.format;
+    if (!layer_surface)
+        return;
+    if (format_changed) {
+        // opaque or not any more
+        recreate_surfaces();
+    } else if (resize && layer_surface_configured) {
+        request_resize();
+    } else if (resize) {
+        // fast-hidden: recreate the surfaces at the new height
+        recreate_surfaces();
+    } else if ((repaint || reshape) && layer_surface_configured && !unmapped) {
+        kbd_draw_layout(&keyboard);
+        wl_surface_damage(draw_surf.surf, 0, 0, keyboard.w, keyboard.h);
+        drwsurf_attach(&draw_surf);
+    } else if (repaint || reshape) {
+        // the kept frame is stale
+        layout_undrawn = true;
+    }
+}
+
+static void
+reload_config()
+{
+    struct settings s;
+
+    if (keyboard.debug)
+        fprintf(stderr, "Reloading %s\n", config_path);
+    settings_load(config_path, &s);
+    apply_config(&s);
+}
+
 void
 refresh_available_dimension()
 {
@@ -855,26 +2003,41 @@ refresh_available_dimension()
 int
 main(int argc, char **argv)
 {
+    clock_gettime(CLOCK_MONOTONIC, &startup_start);
+    startup_last = startup_start;
+
     /* parse command line arguments */
+    bool roundtrip;
     char *layer_names_list = NULL, *landscape_layer_names_list = NULL;
-    char *fc_font_pattern = NULL;
-    height = landscape_height = KBD_PIXEL_LANDSCAPE_HEIGHT;
-    normal_height = KBD_PIXEL_HEIGHT;
+    char *layout_file = NULL, *write_layout_file = NULL;
+    char *lexicon_file = NULL, *write_lexicon_file = NULL;
+    bool predict = false;
+    char *socket_path = NULL;
+    enum stream_format output_format = StreamText;
+    bool print_layers = false;
+    char *layoutset_name = NULL, *wide_layoutset_name = NULL;
 
     char *tmp;
     if ((tmp = getenv("WVKBD_LAYERS")))
         layer_names_list = estrdup(tmp);
     if ((tmp = getenv("WVKBD_LANDSCAPE_LAYERS")))
         landscape_layer_names_list = estrdup(tmp);
-    if ((tmp = getenv("WVKBD_HEIGHT")))
+    if ((tmp = getenv("WVKBD_HEIGHT"))) {
         normal_height = atoi(tmp);
-    if ((tmp = getenv("WVKBD_LANDSCAPE_HEIGHT")))
+        height_given = true;
+    }
+    if ((tmp = getenv("WVKBD_LANDSCAPE_HEIGHT"))) {
         landscape_height = atoi(tmp);
+        landscape_height_given = true;
+    }
+    if ((tmp = getenv("WVKBD_LAYOUT_FILE")))
+        layout_file = estrdup(tmp);
+    if ((tmp = getenv("WVKBD_SOCKET")))
+        socket_path = tmp;
+    if ((tmp = getenv("WVKBD_CONFIG")))
+        config_path = tmp;
 
     /* keyboard settings */
-    keyboard.layers = (enum layout_id *)&layers;
-    keyboard.landscape_layers = (enum layout_id *)&landscape_layers;
-    keyboard.schemes = schemes;
     keyboard.landscape = true;
     keyboard.layer_index = 0;
     keyboard.preferred_scale = 1;
@@ -883,9 +2046,6 @@ main(int argc, char **argv)
     keyboard.show_popup = true;
     keyboard.show_highlight = true;
 
-    uint8_t alpha = 0;
-    bool alpha_defined = false;
-
     int i;
     for (i = 1; argv[i]; i++) {
         if ((!strcmp(argv[i], "-v")) || (!strcmp(argv[i], "--version"))) {
@@ -916,116 +2076,120 @@ main(int argc, char **argv)
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[0].bg.bgra, argv[++i]);
+            set_scheme_colors(0, offsetof(struct clr_scheme, bg), argv[++i]);
+        } else if ((!strcmp(argv[i], "-rgb565")) ||
+                   (!strcmp(argv[i], "--rgb565"))) {
+            rgb565 = true;
         } else if ((!strcmp(argv[i], "-alpha")) ||
                    (!strcmp(argv[i], "--alpha"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            alpha = atoi(argv[++i]);
-            alpha_defined = true;
+            options.alpha = atoi(argv[++i]);
         } else if ((!strcmp(argv[i], "-fg")) || (!strcmp(argv[i], "--fg"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[0].fg.bgra, argv[++i]);
+            set_scheme_colors(0, offsetof(struct clr_scheme, fg), argv[++i]);
         } else if ((!strcmp(argv[i], "-fg-sp")) ||
                    (!strcmp(argv[i], "--fg-sp"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[1].fg.bgra, argv[++i]);
+            set_scheme_colors(1, offsetof(struct clr_scheme, fg), argv[++i]);
         } else if ((!strcmp(argv[i], "-press")) ||
                    (!strcmp(argv[i], "--press"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[0].high.bgra, argv[++i]);
+            set_scheme_colors(0, offsetof(struct clr_scheme, high), argv[++i]);
         } else if ((!strcmp(argv[i], "-press-sp")) ||
                    (!strcmp(argv[i], "--press-sp"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[1].high.bgra, argv[++i]);
+            set_scheme_colors(1, offsetof(struct clr_scheme, high), argv[++i]);
         } else if ((!strcmp(argv[i], "-swipe")) ||
                    (!strcmp(argv[i], "--swipe"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[0].swipe.bgra, argv[++i]);
+            set_scheme_colors(0, offsetof(struct clr_scheme, swipe), argv[++i]);
         } else if ((!strcmp(argv[i], "-swipe-sp")) ||
                    (!strcmp(argv[i], "--swipe-sp"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[1].swipe.bgra, argv[++i]);
+            set_scheme_colors(1, offsetof(struct clr_scheme, swipe), argv[++i]);
         } else if ((!strcmp(argv[i], "-text")) ||
                    (!strcmp(argv[i], "--text"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[0].text.bgra, argv[++i]);
+            set_scheme_colors(0, offsetof(struct clr_scheme, text), argv[++i]);
         } else if ((!strcmp(argv[i], "-text-sp")) ||
                    (!strcmp(argv[i], "--text-sp"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[1].text.bgra, argv[++i]);
+            set_scheme_colors(1, offsetof(struct clr_scheme, text), argv[++i]);
         } else if ((!strcmp(argv[i], "-text-press")) ||
                    (!strcmp(argv[i], "--text-press"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[0].text_press.bgra, argv[++i]);
+            set_scheme_colors(0, offsetof(struct clr_scheme, text_press), argv[++i]);
         } else if ((!strcmp(argv[i], "-text-press-sp")) ||
                    (!strcmp(argv[i], "--text-press-sp"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[1].text_press.bgra, argv[++i]);
+            set_scheme_colors(1, offsetof(struct clr_scheme, text_press), argv[++i]);
         } else if ((!strcmp(argv[i], "-text-swipe")) ||
                    (!strcmp(argv[i], "--text-swipe"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[0].text_swipe.bgra, argv[++i]);
+            set_scheme_colors(0, offsetof(struct clr_scheme, text_swipe), argv[++i]);
         } else if ((!strcmp(argv[i], "-text-swipe-sp")) ||
                    (!strcmp(argv[i], "--text-swipe-sp"))) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            set_kbd_colors(keyboard.schemes[1].text_swipe.bgra, argv[++i]);
+            set_scheme_colors(1, offsetof(struct clr_scheme, text_swipe), argv[++i]);
         } else if (!strcmp(argv[i], "-H")) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
             normal_height = atoi(argv[++i]);
+            height_given = true;
         } else if (!strcmp(argv[i], "-L")) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
             height = landscape_height = atoi(argv[++i]);
+            landscape_height_given = true;
         } else if (!strcmp(argv[i], "-R")) {
             if (i >= argc - 1) {
                 usage(argv[0]);
                 exit(1);
             }
-            rounding = atoi(argv[++i]);
+            options.rounding = atoi(argv[++i]);
         } else if (!strcmp(argv[i], "-D")) {
             keyboard.debug = true;
         } else if ((!strcmp(argv[i], "-fn")) || (!strcmp(argv[i], "--fn"))) {
@@ -1033,14 +2197,27 @@ main(int argc, char **argv)
                 usage(argv[0]);
                 exit(1);
             }
-            fc_font_pattern = estrdup(argv[++i]);
+            options.font = argv[++i];
         } else if (!strcmp(argv[i], "-o")) {
             keyboard.print = true;
         } else if (!strcmp(argv[i], "-O")) {
             keyboard.print_intersect = true;
+        } else if ((!strcmp(argv[i], "-output-format")) ||
+                   (!strcmp(argv[i], "--output-format"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            if (!stream_parse_format(argv[++i], &output_format)) {
+                fprintf(stderr, "Invalid output format: %s\n", argv[i]);
+                exit(1);
+            }
         } else if ((!strcmp(argv[i], "-hidden")) ||
                    (!strcmp(argv[i], "--hidden"))) {
             hidden = true;
+        } else if ((!strcmp(argv[i], "-fast-hide")) ||
+                   (!strcmp(argv[i], "--fast-hide"))) {
+            fast_hide = true;
         } else if ((!strcmp(argv[i], "-no-popup")) ||
                    (!strcmp(argv[i], "--no-popup"))) {
             keyboard.show_popup = false;
@@ -1053,13 +2230,116 @@ main(int argc, char **argv)
             keyboard.show_highlight = false;
         } else if ((!strcmp(argv[i], "-list-layers")) ||
                    (!strcmp(argv[i], "--list-layers"))) {
-            list_layers();
-            exit(0);
+            print_layers = true;
         } else if ((!strcmp(argv[i], "-non-exclusive")) || (!strcmp(argv[i], "--non-exclusive"))) {
             keyboard.exclusive = false;
         } else if ((!strcmp(argv[i], "-auto")) ||
                    (!strcmp(argv[i], "--auto"))) {
             im_auto = true;
+        } else if ((!strcmp(argv[i], "-layout-file")) ||
+                   (!strcmp(argv[i], "--layout-file"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            if (layout_file)
+                free(layout_file);
+            layout_file = estrdup(argv[++i]);
+        } else if ((!strcmp(argv[i], "-lexicon")) ||
+                   (!strcmp(argv[i], "--lexicon"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            lexicon_file = argv[++i];
+        } else if ((!strcmp(argv[i], "-predict")) ||
+                   (!strcmp(argv[i], "--predict"))) {
+            predict = true;
+        } else if ((!strcmp(argv[i], "-write-lexicon")) ||
+                   (!strcmp(argv[i], "--write-lexicon"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            write_lexicon_file = argv[++i];
+        } else if ((!strcmp(argv[i], "-write-layout-file")) ||
+                   (!strcmp(argv[i], "--write-layout-file"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            write_layout_file = argv[++i];
+        } else if ((!strcmp(argv[i], "-socket")) ||
+                   (!strcmp(argv[i], "--socket"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            socket_path = argv[++i];
+        } else if ((!strcmp(argv[i], "-config")) ||
+                   (!strcmp(argv[i], "--config"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            config_path = argv[++i];
+        } else if ((!strcmp(argv[i], "-repeat-delay")) ||
+                   (!strcmp(argv[i], "--repeat-delay"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            keyboard.repeat_delay = atoi(argv[++i]);
+            repeat_delay_given = true;
+        } else if ((!strcmp(argv[i], "-repeat-rate")) ||
+                   (!strcmp(argv[i], "--repeat-rate"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            keyboard.repeat_rate = atoi(argv[++i]);
+            if (keyboard.repeat_rate > 1000)
+                keyboard.repeat_rate = 1000;
+            repeat_rate_given = true;
+        } else if ((!strcmp(argv[i], "-long-press")) ||
+                   (!strcmp(argv[i], "--long-press"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            keyboard.long_press_delay = atoi(argv[++i]);
+            long_press_given = true;
+        } else if ((!strcmp(argv[i], "-layoutset")) ||
+                   (!strcmp(argv[i], "--layoutset"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            layoutset_name = argv[++i];
+        } else if ((!strcmp(argv[i], "-wide-layoutset")) ||
+                   (!strcmp(argv[i], "--wide-layoutset"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            wide_layoutset_name = argv[++i];
+        } else if ((!strcmp(argv[i], "-wide-width")) ||
+                   (!strcmp(argv[i], "--wide-width"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            wide_width = atoi(argv[++i]);
+        } else if ((!strcmp(argv[i], "-stats-file")) ||
+                   (!strcmp(argv[i], "--stats-file"))) {
+            if (i >= argc - 1) {
+                usage(argv[0]);
+                exit(1);
+            }
+            stats_file = argv[++i];
+        } else if ((!strcmp(argv[i], "-startup-profile")) ||
+                   (!strcmp(argv[i], "--startup-profile"))) {
+            startup_profile = true;
         } else {
             fprintf(stderr, "Invalid argument: %s\n", argv[i]);
             usage(argv[0]);
@@ -1067,29 +2347,64 @@ main(int argc, char **argv)
         }
     }
 
-    if (alpha_defined) {
-        keyboard.schemes[0].bg.bgra[3] = alpha;
-        keyboard.schemes[0].fg.bgra[3] = alpha;
-        keyboard.schemes[0].high.bgra[3] = alpha;
-        keyboard.schemes[1].bg.bgra[3] = alpha;
-        keyboard.schemes[1].fg.bgra[3] = alpha;
-        keyboard.schemes[1].high.bgra[3] = alpha;
+    // families are set up once used, those that never are cost nothing
+    kbd_layoutset_setup = setup_layoutset;
+    start_layoutset = layoutset_name ? kbd_builtin_layoutset(layoutset_name)
+                                     : builtin_layoutsets[0].get();
+    if (!start_layoutset) {
+        die("No such layout family: %s\n", layoutset_name);
+    }
+    if (wide_layoutset_name &&
+        !(wide_layoutset = kbd_builtin_layoutset(wide_layoutset_name))) {
+        die("No such layout family: %s\n", wide_layoutset_name);
     }
 
-    if (fc_font_pattern) {
-        for (i = 0; i < countof(schemes); i++)
-            schemes[i].font = fc_font_pattern;
+    if (write_layout_file) {
+        exit(layoutfile_write(start_layoutset, write_layout_file) < 0);
     }
 
-    if (rounding != DEFAULT_ROUNDING) {
-        for (i = 0; i < countof(schemes); i++)
-            schemes[i].rounding = rounding;
+    if (write_lexicon_file) {
+        exit(lexicon_write(stdin, write_lexicon_file) < 0);
     }
 
+    if (lexicon_file) {
+        struct lexicon *lx = lexicon_load(lexicon_file);
+        if (lx) {
+            swipe_set_lexicon(lx);
+            keyboard.swipe_typing = true;
+            predict_set_lexicon(lx);
+            keyboard.predict = predict;
+        } else {
+            fprintf(stderr, "Swipe typing is disabled\n");
+        }
+    }
+    if (predict && !keyboard.predict)
+        fprintf(stderr, "Predictions need a lexicon, they are disabled\n");
+
+    if (layout_file) {
+        // the compiled-in layouts remain the fallback
+        struct layoutset *ls = layoutfile_load(layout_file, start_layoutset);
+        if (ls)
+            start_layoutset = ls;
+        else
+            fprintf(stderr, "Falling back to the compiled-in layouts\n");
+        free(layout_file);
+    }
+
+    if (print_layers) {
+        list_layers(start_layoutset);
+        exit(0);
+    }
+
+    use_layoutset(start_layoutset);
+
+    profile_phase("arguments and layouts");
+
     display = wl_display_connect(NULL);
     if (display == NULL) {
         die("Failed to create display\n");
     }
+    profile_phase("connect");
 
     draw_surf.ctx = &draw_ctx;
     draw_surf.back_buffer = &draw_surf_back_buffer;
@@ -1097,12 +2412,38 @@ main(int argc, char **argv)
     popup_draw_surf.ctx = &draw_ctx;
     popup_draw_surf.back_buffer = &popup_draw_surf_back_buffer;
     popup_draw_surf.display_buffer = &popup_draw_surf_display_buffer;
+    highlight_surf.ctx = &draw_ctx;
+    highlight_surf.back_buffer = &highlight_surf_back_buffer;
+    highlight_surf.display_buffer = &highlight_surf_display_buffer;
+    keyboard.highlight_surf = &highlight_surf;
     keyboard.surf = &draw_surf;
     keyboard.popup_surf = &popup_draw_surf;
 
     struct wl_registry *registry = wl_display_get_registry(display);
     wl_registry_add_listener(registry, &registry_listener, NULL);
-    wl_display_roundtrip(display);
+    start_roundtrip(&roundtrip);
+
+    // While the compositor announces its globals: prepare the layout tables
+    // and the initial keymap, and load the fonts
+    kbd_init(&keyboard, start_layoutset, layer_names_list,
+             landscape_layer_names_list);
+    profile_phase("keyboard and keymap");
+
+    // the config file goes over the command line, and is watched from now on
+    // so that no change is missed
+    if (config_path) {
+        config_fd = settings_watch(config_path);
+        struct settings s;
+        settings_load(config_path, &s);
+        apply_config(&s);
+        profile_phase("config file");
+    }
+
+    load_fonts(start_layoutset);
+    profile_phase("fonts");
+
+    finish_roundtrip(&roundtrip);
+    profile_phase("registry roundtrip");
 
     if (compositor == NULL) {
         die("wl_compositor not available\n");
@@ -1120,9 +2461,6 @@ main(int argc, char **argv)
         die("virtual_keyboard_manager not available\n");
     }
 
-    // A second round-trip to receive wl_outputs events
-    wl_display_roundtrip(display);
-
     empty_region = wl_compositor_create_region(compositor);
     popup_xdg_positioner = xdg_wm_base_create_positioner(wm_base);
 
@@ -1131,35 +2469,52 @@ main(int argc, char **argv)
     if (keyboard.vkbd == NULL) {
         die("failed to init virtual keyboard_manager\n");
     }
-    #ifdef SHIFT_SPACE_IS_TAB
-    keyboard.shift_space_is_tab = true;
-    #else
-    keyboard.shift_space_is_tab = false;
-    #endif
-
-    kbd_init(&keyboard, (struct layout *)&layouts, layer_names_list,
-             landscape_layer_names_list);
+    kbd_upload_keymap(&keyboard, keyboard.keymap_fd, keyboard.keymap_size);
 
     if (im_mgr != NULL) {
-        struct zwp_input_method_v2 *input_method =
+        keyboard.im =
             zwp_input_method_manager_v2_get_input_method(im_mgr, seat);
-        zwp_input_method_v2_add_listener(input_method, &input_method_listener, NULL);
+        zwp_input_method_v2_add_listener(keyboard.im, &input_method_listener, NULL);
     }
 
-    for (i = 0; i < countof(schemes); i++) {
-        schemes[i].font_description =
-            pango_font_description_from_string(schemes[i].font);
+    // A second round-trip to receive wl_outputs events, the requests above
+    // go out with it
+    start_roundtrip(&roundtrip);
+    finish_roundtrip(&roundtrip);
+    profile_phase("output roundtrip");
+
+    // wl_shm formats came with the roundtrips
+    if (!choose_format(keyboard.layoutset) && rgb565) {
+        fprintf(stderr, "The colors are not opaque, not using RGB565\n");
     }
 
     if (!hidden)
         show();
+    profile_phase("show");
+
+    if (socket_path && control_listen(socket_path, control_command) < 0) {
+        die("Failed to open control socket %s\n", socket_path);
+    }
+    if ((keyboard.print || keyboard.print_intersect) &&
+        stream_open(STDOUT_FILENO, output_format) < 0) {
+        die("Failed to set up output\n");
+    }
 
-    struct pollfd fds[2];
+    struct pollfd fds[7 + CONTROL_MAX_CLIENTS];
     int WAYLAND_FD = 0;
     int SIGNAL_FD = 1;
+    int REPEAT_FD = 2;
+    int LONG_PRESS_FD = 3;
+    int OUTPUT_FD = 4;
+    int CONFIG_FD = 5;
+    int CONTROL_FDS = 6;
     fds[WAYLAND_FD].events = POLLIN;
     fds[SIGNAL_FD].events = POLLIN;
 
+    // -1 is skipped by poll if there is no config file
+    fds[CONFIG_FD].events = POLLIN;
+    fds[CONFIG_FD].fd = config_fd;
+
     fds[WAYLAND_FD].fd = wl_display_get_fd(display);
     if (fds[WAYLAND_FD].fd == -1) {
         die("Failed to get wayland_fd: %d\n", errno);
@@ -1170,6 +2525,7 @@ main(int argc, char **argv)
     sigaddset(&signal_mask, SIGUSR1);
     sigaddset(&signal_mask, SIGUSR2);
     sigaddset(&signal_mask, SIGRTMIN);
+    sigaddset(&signal_mask, SIGRTMIN + 1);
     sigaddset(&signal_mask, SIGPIPE);
     if (sigprocmask(SIG_BLOCK, &signal_mask, NULL) == -1) {
         die("Failed to disable handled signals: %d\n", errno);
@@ -1180,9 +2536,27 @@ main(int argc, char **argv)
         die("Failed to get signalfd: %d\n", errno);
     }
 
+    // only armed while a key is held, so they cause no wakeups otherwise.
+    // Both are made even if disabled, another layout family may enable them.
+    fds[REPEAT_FD].events = POLLIN;
+    fds[REPEAT_FD].fd = keyboard.repeat_fd =
+        timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (keyboard.repeat_fd == -1) {
+        die("Failed to get timerfd: %d\n", errno);
+    }
+
+    fds[LONG_PRESS_FD].events = POLLIN;
+    fds[LONG_PRESS_FD].fd = keyboard.long_press_fd =
+        timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (keyboard.long_press_fd == -1) {
+        die("Failed to get timerfd: %d\n", errno);
+    }
+
     while (run_display) {
+        size_t ncontrol = control_pollfds(&fds[CONTROL_FDS]);
+        stream_pollfd(&fds[OUTPUT_FD]);
         wl_display_flush(display);
-        poll(fds, 2, -1);
+        poll(fds, CONTROL_FDS + ncontrol, -1);
 
         if (fds[WAYLAND_FD].revents & POLLIN)
             wl_display_dispatch(display);
@@ -1204,16 +2578,29 @@ main(int argc, char **argv)
                 show();
             else if (si.ssi_signo == SIGRTMIN)
                 toggle_visibility();
+            else if (si.ssi_signo == SIGRTMIN + 1)
+                dump_stats();
             else if (si.ssi_signo == SIGPIPE)
                 pipewarn();
         }
-    }
 
-    if (fc_font_pattern) {
-        free((void *)fc_font_pattern);
-        for (i = 0; i < countof(schemes); i++)
-            schemes[i].font = NULL;
+        if (fds[REPEAT_FD].revents & POLLIN)
+            kbd_repeat(&keyboard);
+        if (fds[LONG_PRESS_FD].revents & POLLIN)
+            kbd_long_press(&keyboard);
+        if (fds[OUTPUT_FD].revents)
+            stream_flush();
+        if ((fds[CONFIG_FD].revents & POLLIN) &&
+            settings_changed(config_fd, config_path))
+            reload_config();
+
+        control_dispatch(&fds[CONTROL_FDS], ncontrol);
     }
 
+    control_close();
+    stream_close();
+    if (stats_file)
+        dump_stats();
+
     return 0;
 }
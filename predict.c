@@ -0,0 +1,180 @@
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+#include <wctype.h>
+
+#include "predict.h"
+#include "utf8.h"
+
+struct candidate {
+    const struct lexicon_node *node;
+    uint16_t key;  // best frequency reachable, or the word's own frequency
+    bool word;     // the word ending at node, rather than its subtree
+    uint8_t len;
+    uint32_t cps[LEXICON_WORD_MAX];
+};
+
+static const struct lexicon *lexicon;
+// node of each prefix of the current word, NULL once it left the lexicon
+static const struct lexicon_node *nodes[LEXICON_WORD_MAX + 1];
+static uint32_t letters[LEXICON_WORD_MAX];
+static size_t length; // may exceed LEXICON_WORD_MAX, the rest is not kept
+static struct candidate queue[PREDICT_QUEUE];
+static size_t queued;
+
+void
+predict_set_lexicon(const struct lexicon *lx)
+{
+    // letters and their case as lexicon_write knew them
+    if (lx && !setlocale(LC_CTYPE, "C.UTF-8"))
+        fprintf(stderr, "No C.UTF-8 locale, predictions only know ASCII "
+                        "letters\n");
+    lexicon = lx;
+    predict_reset();
+}
+
+void
+predict_reset(void)
+{
+    length = 0;
+    nodes[0] = lexicon ? &lexicon->nodes[0] : NULL;
+}
+
+/* Letters are what words are made of, anything else ends a word */
+static bool
+is_letter(uint32_t cp)
+{
+    return cp == '\'' || iswalpha(cp);
+}
+
+void
+predict_push(uint32_t cp)
+{
+    if (!is_letter(cp)) {
+        predict_reset();
+        return;
+    }
+    if (length < LEXICON_WORD_MAX) {
+        const struct lexicon_node *n = nodes[length];
+        cp = towlower(cp);
+        letters[length] = cp;
+        nodes[length + 1] = n ? lexicon_child(lexicon, n, cp) : NULL;
+    }
+    length++;
+}
+
+void
+predict_pop(void)
+{
+    if (length)
+        length--;
+}
+
+void
+predict_set_text(const char *text, size_t len)
+{
+    size_t start = 0;
+    for (size_t i = 0; i < len;) {
+        uint32_t cp;
+        i += utf8_decode(text + i, &cp);
+        if (!is_letter(cp))
+            start = i;
+    }
+    predict_reset();
+    for (size_t i = start; i < len;) {
+        uint32_t cp;
+        i += utf8_decode(text + i, &cp);
+        predict_push(cp);
+    }
+}
+
+size_t
+predict_length(void)
+{
+    return length;
+}
+
+static void
+queue_push(const struct candidate *c)
+{
+    size_t slot = queued;
+    if (queued == PREDICT_QUEUE) {
+        // full: replace the least promising, if this is better
+        slot = 0;
+        for (size_t i = 1; i < queued; i++) {
+            if (queue[i].key < queue[slot].key)
+                slot = i;
+        }
+        if (queue[slot].key >= c->key)
+            return;
+    } else {
+        queued++;
+    }
+    queue[slot] = *c;
+}
+
+static void
+queue_pop(struct candidate *c)
+{
+    size_t best = 0;
+    for (size_t i = 1; i < queued; i++) {
+        if (queue[i].key > queue[best].key)
+            best = i;
+    }
+    *c = queue[best];
+    queue[best] = queue[--queued];
+}
+
+size_t
+predict_complete(struct prediction *out, size_t max)
+{
+    const struct lexicon_node *n;
+    struct candidate c;
+    size_t count = 0;
+
+    if (!lexicon || !length || length > LEXICON_WORD_MAX ||
+        !(n = nodes[length]))
+        return 0;
+
+    // A word is queued with its own frequency, which is never more than the
+    // best of the subtree it was found in, so words come out most frequent
+    // first
+    queued = 0;
+    c = (struct candidate){.node = n, .key = n->best, .len = length};
+    memcpy(c.cps, letters, length * sizeof(*letters));
+    queue_push(&c);
+    while (queued && count < max) {
+        queue_pop(&c);
+        if (c.word) {
+            char *w = out[count].word;
+            for (size_t i = 0; i < c.len; i++) {
+                if (i == length)
+                    out[count].typed = w - out[count].word;
+                w += utf8_encode(w, c.cps[i]);
+            }
+            *w = '\0';
+            count++;
+            continue;
+        }
+
+        n = c.node;
+        // the word typed so far is no completion
+        if (n->freq && c.len > length) {
+            struct candidate word = c;
+            word.word = true;
+            word.key = n->freq;
+            queue_push(&word);
+        }
+        if (c.len == LEXICON_WORD_MAX)
+            continue;
+        for (uint16_t i = 0; i < n->childcount; i++) {
+            const struct lexicon_node *child = &lexicon->nodes[n->children + i];
+            struct candidate next = c;
+            next.node = child;
+            next.key = child->best;
+            next.cps[next.len++] = child->cp;
+            queue_push(&next);
+        }
+    }
+    return count;
+}
@@ -0,0 +1,37 @@
+#ifndef __PREDICT_H
+#define __PREDICT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lexicon.h"
+
+/* Word prediction
+ *
+ * Follows the word being typed down the lexicon trie, one node per letter, so
+ * each keystroke costs a single child lookup. Completions are found best
+ * first: nodes are expanded in order of the highest frequency below them, so
+ * only the paths to the few most frequent completions are visited, however
+ * many words share the prefix.
+ */
+
+#define PREDICT_QUEUE 64 // nodes considered at once while completing
+
+struct prediction {
+	char word[LEXICON_WORD_MAX * 4 + 1];
+	size_t typed; // bytes of word that are already typed
+};
+
+void predict_set_lexicon(const struct lexicon *lx);
+
+void predict_reset(void);
+void predict_push(uint32_t cp); // a letter was typed, or else the word ended
+void predict_pop(void);         // the last letter was deleted
+/* Start over with the word at the end of text */
+void predict_set_text(const char *text, size_t len);
+size_t predict_length(void); // letters in the current word
+
+/* The most frequent completions of the current word, most frequent first */
+size_t predict_complete(struct prediction *out, size_t max);
+
+#endif
@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "keyboard.h"
+#include "settings.h"
+
+#define SCHEME_COLOR(name, scheme, color)                                      \
+    { name, scheme, offsetof(struct clr_scheme, color) }
+
+const struct settings_color settings_colors[SETTINGS_COLORS] = {
+    SCHEME_COLOR("bg", 0, bg),
+    SCHEME_COLOR("fg", 0, fg),
+    SCHEME_COLOR("fg-sp", 1, fg),
+    SCHEME_COLOR("press", 0, high),
+    SCHEME_COLOR("press-sp", 1, high),
+    SCHEME_COLOR("swipe", 0, swipe),
+    SCHEME_COLOR("swipe-sp", 1, swipe),
+    SCHEME_COLOR("text", 0, text),
+    SCHEME_COLOR("text-sp", 1, text),
+    SCHEME_COLOR("text-press", 0, text_press),
+    SCHEME_COLOR("text-press-sp", 1, text_press),
+    SCHEME_COLOR("text-swipe", 0, text_swipe),
+    SCHEME_COLOR("text-swipe-sp", 1, text_swipe),
+};
+
+static bool
+valid_color(const char *value)
+{
+    size_t len = strlen(value);
+    if (len != 6 && len != 8)
+        return false;
+    for (size_t i = 0; i < len; i++) {
+        if (!isxdigit((unsigned char)value[i]))
+            return false;
+    }
+    return true;
+}
+
+/* A number from min to max, -1 if it isn't one */
+static long
+parse_number(const char *value, long min, long max)
+{
+    char *end;
+    errno = 0;
+    long n = strtol(value, &end, 10);
+    if (!*value || *end || errno || n < min || n > max)
+        return -1;
+    return n;
+}
+
+static char *
+trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+    return s;
+}
+
+/* Set one setting, NULL if done or else what is wrong */
+static const char *
+settings_set(struct settings *s, const char *name, const char *value)
+{
+    long n;
+
+    for (size_t i = 0; i < SETTINGS_COLORS; i++) {
+        if (strcmp(name, settings_colors[i].name))
+            continue;
+        if (!valid_color(value))
+            return "invalid value";
+        free(s->colors[i]);
+        s->colors[i] = strdup(value);
+        return NULL;
+    }
+    if (!strcmp(name, "alpha")) {
+        if ((n = parse_number(value, 0, 255)) < 0)
+            return "invalid value";
+        s->alpha = n;
+    } else if (!strcmp(name, "fn")) {
+        if (!*value)
+            return "invalid value";
+        free(s->font);
+        s->font = strdup(value);
+    } else if (!strcmp(name, "rounding")) {
+        if ((n = parse_number(value, 0, 255)) < 0)
+            return "invalid value";
+        s->rounding = n;
+    } else if (!strcmp(name, "height")) {
+        if ((n = parse_number(value, 1, UINT16_MAX)) < 0)
+            return "invalid value";
+        s->height = n;
+    } else if (!strcmp(name, "landscape-height")) {
+        if ((n = parse_number(value, 1, UINT16_MAX)) < 0)
+            return "invalid value";
+        s->landscape_height = n;
+    } else if (!strcmp(name, "layers")) {
+        if (!*value)
+            return "invalid value";
+        free(s->layers);
+        s->layers = strdup(value);
+    } else if (!strcmp(name, "landscape-layers")) {
+        if (!*value)
+            return "invalid value";
+        free(s->landscape_layers);
+        s->landscape_layers = strdup(value);
+    } else {
+        return "unknown setting";
+    }
+    return NULL;
+}
+
+void
+settings_load(const char *path, struct settings *s)
+{
+    char *line = NULL;
+    size_t size = 0;
+    unsigned lineno = 0;
+
+    *s = (struct settings){.alpha = -1, .rounding = -1};
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        if (errno != ENOENT)
+            perror(path);
+        return;
+    }
+    while (getline(&line, &size, f) > 0) {
+        lineno++;
+        line[strcspn(line, "#")] = '\0';
+        char *name = trim(line);
+        if (!*name)
+            continue;
+        char *eq = strchr(name, '=');
+        if (!eq) {
+            fprintf(stderr, "%s:%u: expected name = value\n", path, lineno);
+            continue;
+        }
+        *eq = '\0';
+        name = trim(name);
+        char *value = trim(eq + 1);
+        const char *error = settings_set(s, name, value);
+        if (error)
+            fprintf(stderr, "%s:%u: %s %s\n", path, lineno, error, name);
+    }
+    free(line);
+    fclose(f);
+}
+
+void
+settings_free(struct settings *s)
+{
+    for (size_t i = 0; i < SETTINGS_COLORS; i++)
+        free(s->colors[i]);
+    free(s->font);
+    free(s->layers);
+    free(s->landscape_layers);
+    *s = (struct settings){.alpha = -1, .rounding = -1};
+}
+
+int
+settings_watch(const char *path)
+{
+    // not IN_MODIFY: a file being written is read once it is closed
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+    char *dir = strdup(path);
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd >= 0 && inotify_add_watch(fd, dirname(dir), mask) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0)
+        perror(path);
+    free(dir);
+    return fd;
+}
+
+bool
+settings_changed(int fd, const char *path)
+{
+    char buf[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    char *copy = strdup(path);
+    const char *name = basename(copy);
+    bool changed = false;
+    ssize_t len;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len;) {
+            const struct inotify_event *ev = (const void *)p;
+            if (ev->len && !strcmp(ev->name, name))
+                changed = true;
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+    free(copy);
+    return changed;
+}
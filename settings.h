@@ -0,0 +1,50 @@
+#ifndef __SETTINGS_H
+#define __SETTINGS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Config file
+ *
+ * Settings that can be changed while running, read from a file of
+ * "name = value" lines, "#" starting a comment. The names are those of the
+ * command line options without dashes: the colors (bg, fg, fg-sp, press, ...),
+ * alpha, fn, rounding, height, landscape-height, layers and landscape-layers.
+ *
+ * The directory of the file is watched with inotify, so that the file is read
+ * again when it is written, replaced (as editors save) or removed.
+ */
+
+#define SETTINGS_COLORS 13
+
+struct settings_color {
+	const char *name;
+	size_t scheme; // index of the scheme it sets
+	size_t offset; // of its Color in struct clr_scheme
+};
+
+/* The colors of the config file, in the order of settings.colors */
+extern const struct settings_color settings_colors[SETTINGS_COLORS];
+
+/* A setting not in the file is NULL, 0 or -1 */
+struct settings {
+	char *colors[SETTINGS_COLORS]; // rrggbb or rrggbbaa
+	int alpha;
+	char *font;
+	int rounding;
+	uint32_t height, landscape_height;
+	char *layers, *landscape_layers; // comma separated
+};
+
+/* Read the file; a missing one has no settings. Unknown names and bad values
+ * are reported and skipped. */
+void settings_load(const char *path, struct settings *s);
+void settings_free(struct settings *s);
+
+/* Watch the file, returns the fd to poll or -1 */
+int settings_watch(const char *path);
+/* Read the events on the fd, true if the file changed */
+bool settings_changed(int fd, const char *path);
+
+#endif
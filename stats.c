@@ -0,0 +1,173 @@
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+struct histogram {
+    uint64_t count, sum, min, max;
+    uint32_t buckets[STATS_BUCKETS];
+};
+
+static uint64_t counters[NumStatCounters];
+static struct histogram histograms[NumStatHistograms];
+static uint64_t press_time; // 0 if no press is waiting for a commit
+
+static const char *counter_names[NumStatCounters] = {
+    [StatTouches] = "touches",
+    [StatKeyEvents] = "key_events",
+    [StatLayoutRedraws] = "layout_redraws",
+    [StatKeyRedraws] = "key_redraws",
+    [StatCommits] = "commits",
+    [StatDamagedPixels] = "damaged_pixels",
+    [StatFrameWaits] = "frame_waits",
+    [StatKeymapUploads] = "keymap_uploads",
+    [StatKeymapBytes] = "keymap_bytes",
+    [StatShmBytes] = "shm_bytes",
+    [StatOutputDropped] = "output_dropped",
+    [StatSprites] = "sprites",
+};
+
+static const char *histogram_names[NumStatHistograms] = {
+    [StatPressLatency] = "press_latency_us",
+    [StatDrawLayout] = "draw_layout_us",
+    [StatCommitDamage] = "commit_damage_pixels",
+    [StatSwipeDecode] = "swipe_decode_us",
+    [StatPredict] = "predict_us",
+};
+
+uint64_t
+stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t
+bucket_index(uint64_t value)
+{
+    if (value < STATS_SUB_BUCKETS)
+        return value;
+    // the top three bits below the leading one pick the linear sub bucket
+    int e = 63 - __builtin_clzll(value);
+    size_t sub = (value >> (e - 3)) & (STATS_SUB_BUCKETS - 1);
+    return (e - 2) * STATS_SUB_BUCKETS + sub;
+}
+
+static uint64_t
+bucket_lowest(size_t index)
+{
+    if (index < STATS_SUB_BUCKETS)
+        return index;
+    int e = index / STATS_SUB_BUCKETS + 2;
+    uint64_t sub = index % STATS_SUB_BUCKETS;
+    return (STATS_SUB_BUCKETS + sub) << (e - 3);
+}
+
+void
+stats_count(enum stat_counter c, uint64_t n)
+{
+    counters[c] += n;
+}
+
+void
+stats_record(enum stat_histogram h, uint64_t value)
+{
+    struct histogram *hist = &histograms[h];
+    if (!hist->count || value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+    hist->count++;
+    hist->sum += value;
+    hist->buckets[bucket_index(value)]++;
+}
+
+void
+stats_press(void)
+{
+    press_time = stats_now();
+}
+
+void
+stats_commit(uint64_t damaged_pixels)
+{
+    counters[StatCommits]++;
+    counters[StatDamagedPixels] += damaged_pixels;
+    stats_record(StatCommitDamage, damaged_pixels);
+    if (press_time) {
+        stats_record(StatPressLatency, stats_now() - press_time);
+        press_time = 0;
+    }
+}
+
+void
+stats_reset(void)
+{
+    memset(counters, 0, sizeof(counters));
+    memset(histograms, 0, sizeof(histograms));
+    press_time = 0;
+}
+
+/* Highest value that is equivalent to the one at the given quantile */
+static uint64_t
+histogram_quantile(struct histogram *hist, double q)
+{
+    uint64_t rank = q * hist->count, seen = 0;
+    if (rank >= hist->count)
+        rank = hist->count - 1;
+    for (size_t i = 0; i < STATS_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen > rank) {
+            uint64_t highest = i + 1 < STATS_BUCKETS
+                                   ? bucket_lowest(i + 1) - 1
+                                   : UINT64_MAX;
+            return highest < hist->max ? highest : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+void
+stats_write_json(FILE *f, bool buckets)
+{
+    fprintf(f, "{\"counters\":{");
+    for (int c = 0; c < NumStatCounters; c++) {
+        fprintf(f, "%s\"%s\":%llu", c ? "," : "", counter_names[c],
+                (unsigned long long)counters[c]);
+    }
+    fprintf(f, "},\"histograms\":{");
+    for (int h = 0; h < NumStatHistograms; h++) {
+        struct histogram *hist = &histograms[h];
+        fprintf(f, "%s\"%s\":{\"count\":%llu", h ? "," : "",
+                histogram_names[h], (unsigned long long)hist->count);
+        if (hist->count) {
+            fprintf(f,
+                    ",\"min\":%llu,\"max\":%llu,\"mean\":%.1f,\"p50\":%llu,"
+                    "\"p90\":%llu,\"p99\":%llu,\"p999\":%llu",
+                    (unsigned long long)hist->min,
+                    (unsigned long long)hist->max,
+                    (double)hist->sum / hist->count,
+                    (unsigned long long)histogram_quantile(hist, 0.5),
+                    (unsigned long long)histogram_quantile(hist, 0.9),
+                    (unsigned long long)histogram_quantile(hist, 0.99),
+                    (unsigned long long)histogram_quantile(hist, 0.999));
+        }
+        if (buckets) {
+            // [lowest value, count] of each non-empty bucket
+            bool first = true;
+            fprintf(f, ",\"buckets\":[");
+            for (size_t i = 0; i < STATS_BUCKETS; i++) {
+                if (!hist->buckets[i])
+                    continue;
+                fprintf(f, "%s[%llu,%u]", first ? "" : ",",
+                        (unsigned long long)bucket_lowest(i),
+                        hist->buckets[i]);
+                first = false;
+            }
+            fprintf(f, "]");
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "}}\n");
+}
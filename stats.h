@@ -0,0 +1,59 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Performance counters and latency histograms
+ *
+ * Always maintained; they cost a few additions per event. Histograms are
+ * log-linear (HDR style): values are bucketed by their power of two, each
+ * split into STATS_SUB_BUCKETS linear steps, so that every recorded value is
+ * known within 1/STATS_SUB_BUCKETS of its magnitude.
+ */
+
+enum stat_counter {
+	StatTouches,       // presses from touch or pointer
+	StatKeyEvents,     // key events sent to the virtual keyboard
+	StatLayoutRedraws, // full layout redraws
+	StatKeyRedraws,    // single key redraws
+	StatCommits,       // buffers attached and committed
+	StatDamagedPixels, // damaged pixels over all commits
+	StatFrameWaits,    // frame callbacks requested
+	StatKeymapUploads,
+	StatKeymapBytes,
+	StatShmBytes,      // shared memory allocated for buffers
+	StatOutputDropped, // output events dropped, the consumer was too slow
+	StatSprites,       // color glyph labels rasterized into the sprite cache
+	NumStatCounters,
+};
+
+enum stat_histogram {
+	StatPressLatency, // press to the next commit, microseconds
+	StatDrawLayout,   // kbd_draw_layout, microseconds
+	StatCommitDamage, // damaged pixels per commit
+	StatSwipeDecode,  // decoding a swipe into words, microseconds
+	StatPredict,      // completing the current word, microseconds
+	NumStatHistograms,
+};
+
+#define STATS_SUB_BUCKETS 8
+#define STATS_BUCKETS (64 * STATS_SUB_BUCKETS)
+
+uint64_t stats_now(void); // monotonic clock, microseconds
+
+void stats_count(enum stat_counter c, uint64_t n);
+void stats_record(enum stat_histogram h, uint64_t value);
+
+/* Press latency: remember when a key was pressed, and record the time to the
+ * first commit following it */
+void stats_press(void);
+void stats_commit(uint64_t damaged_pixels);
+
+void stats_reset(void);
+/* Write all counters and histograms as a single line of JSON, with the
+ * non-empty buckets of each histogram if buckets is set */
+void stats_write_json(FILE *f, bool buckets);
+
+#endif
@@ -0,0 +1,216 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "stream.h"
+
+#define EVENT_MAX (sizeof(struct stream_record) + 6 * STREAM_LABEL_MAX + 256)
+
+static char ring[STREAM_BUFFER_SIZE];
+static size_t head, len; // start and length of the data not written yet
+static int out_fd = -1;
+static int out_flags; // of the fd as it was opened, restored on close
+static enum stream_format out_format;
+static uint64_t dropped; // events dropped since the last one queued
+
+static const char *event_names[] = {
+    [StreamPress] = "press",
+    [StreamRepeat] = "repeat",
+    [StreamSwipe] = "swipe",
+    [StreamSwipeEnd] = "swipe_end",
+    [StreamOverflow] = "overflow",
+};
+
+int
+stream_open(int fd, enum stream_format format)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        perror("output: fcntl");
+        return -1;
+    }
+    out_fd = fd;
+    out_flags = flags;
+    out_format = format;
+    return 0;
+}
+
+void
+stream_close(void)
+{
+    if (out_fd < 0)
+        return;
+    // the file description is shared with whoever else writes to it, so it
+    // goes back to blocking, and what is left is written before exiting
+    if (fcntl(out_fd, F_SETFL, out_flags) < 0)
+        perror("output: fcntl");
+    stream_flush();
+    out_fd = -1;
+}
+
+bool
+stream_parse_format(const char *name, enum stream_format *format)
+{
+    if (!strcmp(name, "text"))
+        *format = StreamText;
+    else if (!strcmp(name, "json"))
+        *format = StreamJSON;
+    else if (!strcmp(name, "binary"))
+        *format = StreamBinary;
+    else
+        return false;
+    return true;
+}
+
+/* Queue all of the data or nothing */
+static bool
+stream_put(const char *data, size_t n)
+{
+    if (n > STREAM_BUFFER_SIZE - len)
+        return false;
+    size_t tail = (head + len) % STREAM_BUFFER_SIZE;
+    size_t first = STREAM_BUFFER_SIZE - tail;
+    if (first > n)
+        first = n;
+    memcpy(ring + tail, data, first);
+    memcpy(ring, data + first, n - first);
+    len += n;
+    return true;
+}
+
+/* Label length in bytes, cut at STREAM_LABEL_MAX on a character boundary */
+static size_t
+label_length(const char *label)
+{
+    size_t n = strlen(label);
+    if (n <= STREAM_LABEL_MAX)
+        return n;
+    n = STREAM_LABEL_MAX;
+    while (n && (label[n] & 0xC0) == 0x80)
+        n--;
+    return n;
+}
+
+static size_t
+format_json(char *buf, const struct stream_record *r, const char *label)
+{
+    size_t n = 0, ln = label_length(label);
+
+    n += sprintf(buf + n, "{\"type\":\"%s\"", event_names[r->type]);
+    if (r->type == StreamOverflow)
+        return n + sprintf(buf + n, ",\"dropped\":%u}\n", r->code);
+
+    n += sprintf(buf + n, ",\"time\":%u", r->time);
+    if (r->type != StreamSwipeEnd) {
+        n += sprintf(buf + n, ",\"code\":%u,\"mods\":%u,\"label\":\"",
+                     r->code, r->mods);
+        for (size_t i = 0; i < ln; i++) {
+            unsigned char c = label[i];
+            if (c == '"' || c == '\\')
+                n += sprintf(buf + n, "\\%c", c);
+            else if (c < 0x20)
+                n += sprintf(buf + n, "\\u%04x", c);
+            else
+                buf[n++] = c;
+        }
+        buf[n++] = '"';
+        if (r->w && r->h)
+            n += sprintf(buf + n, ",\"key\":[%u,%u,%u,%u]", r->x, r->y, r->w,
+                         r->h);
+    }
+    n += sprintf(buf + n, ",\"touch\":[%d,%d]}\n", r->touch_x, r->touch_y);
+    return n;
+}
+
+static size_t
+format_event(char *buf, struct stream_record *r, const char *label,
+             const char *text)
+{
+    switch (out_format) {
+    case StreamText:
+        strcpy(buf, text);
+        return strlen(buf);
+    case StreamJSON:
+        return format_json(buf, r, label);
+    case StreamBinary:
+        r->label_len = label_length(label);
+        memcpy(buf, r, sizeof(*r));
+        memcpy(buf + sizeof(*r), label, r->label_len);
+        return sizeof(*r) + r->label_len;
+    }
+    return 0;
+}
+
+void
+stream_event(struct stream_record *r, const char *label, const char *text)
+{
+    char buf[EVENT_MAX], overflow_buf[EVENT_MAX];
+    size_t n, overflow_n = 0;
+
+    if (out_fd < 0)
+        return;
+    n = format_event(buf, r, label, text);
+    if (!n)
+        return;
+
+    if (dropped && out_format != StreamText) {
+        struct stream_record overflow = {
+            .type = StreamOverflow,
+            .code = dropped,
+            .time = r->time,
+        };
+        overflow_n = format_event(overflow_buf, &overflow, "", "");
+    }
+    // the overflow event only goes in along with the event that follows it
+    if (overflow_n + n > STREAM_BUFFER_SIZE - len) {
+        if (!dropped)
+            fprintf(stderr, "output: not read fast enough, dropping keys\n");
+        dropped++;
+        stats_count(StatOutputDropped, 1);
+        return;
+    }
+    if (dropped) {
+        if (out_format == StreamText)
+            fprintf(stderr, "output: %llu keys were dropped\n",
+                    (unsigned long long)dropped);
+        dropped = 0;
+    }
+    stream_put(overflow_buf, overflow_n);
+    stream_put(buf, n);
+    stream_flush();
+}
+
+void
+stream_pollfd(struct pollfd *fd)
+{
+    fd->fd = len ? out_fd : -1;
+    fd->events = POLLOUT;
+    fd->revents = 0;
+}
+
+void
+stream_flush(void)
+{
+    while (len && out_fd >= 0) {
+        size_t chunk = STREAM_BUFFER_SIZE - head;
+        if (chunk > len)
+            chunk = len;
+        ssize_t n = write(out_fd, ring + head, chunk);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // the consumer is gone, stop writing
+                perror("output");
+                len = 0;
+                out_fd = -1;
+            }
+            return;
+        }
+        head = (head + n) % STREAM_BUFFER_SIZE;
+        len -= n;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Key output stream (-o and -O)
+ *
+ * Events are queued in a ring buffer and written to a non-blocking fd from the
+ * main loop, so a consumer that reads slowly never stalls typing. When the
+ * buffer is full whole events are dropped and counted, and the next event that
+ * fits is preceded by an overflow event (json, binary) or a warning on
+ * standard error (text).
+ */
+
+enum stream_format {
+	StreamText = 0, // what the keys type, as -o always printed
+	StreamJSON,     // one JSON object per line
+	StreamBinary,   // struct stream_record, then the label
+};
+
+enum stream_event {
+	StreamPress = 0,
+	StreamRepeat,
+	StreamSwipe,    // a key crossed while swiping (-O)
+	StreamSwipeEnd, // the end of a swipe
+	StreamOverflow, // events were dropped before this one
+};
+
+#define STREAM_BUFFER_SIZE 65536
+#define STREAM_LABEL_MAX 64
+
+/* Binary events are this record, in host byte order, followed by label_len
+ * bytes of UTF-8 label */
+struct stream_record {
+	uint32_t time; // event time from the compositor, ms
+	uint32_t code; // key code, code point of Copy keys, or for StreamOverflow
+	               // the number of events dropped
+	int32_t touch_x, touch_y; // where the key was touched
+	uint16_t x, y, w, h;      // key rectangle, all 0 if not shown
+	uint8_t type;             // enum stream_event
+	uint8_t mods;
+	uint16_t label_len;
+};
+
+int stream_open(int fd, enum stream_format format);
+/* Write what is queued, blocking unless the fd was non-blocking already, and
+ * give the fd back its flags */
+void stream_close(void);
+bool stream_parse_format(const char *name, enum stream_format *format);
+
+/* Queue an event, written as text in the text format and from the record and
+ * label otherwise */
+void stream_event(struct stream_record *r, const char *label,
+                  const char *text);
+
+/* Fill in the fd to poll, -1 if there is nothing to write */
+void stream_pollfd(struct pollfd *fd);
+/* Write as much of the queue as the fd takes without blocking */
+void stream_flush(void);
+
+#endif
@@ -0,0 +1,208 @@
+#include <math.h>
+#include <string.h>
+
+#include "swipe.h"
+#include "utf8.h"
+
+#define MIN_SPACING 0.25f      // between recorded points
+#define MAX_END_DISTANCE 1.0f  // of the first and last letters to the path ends
+#define MAX_MEAN_DISTANCE 0.6f // of the other letters to the path, on average
+#define FREQ_WEIGHT 0.5f       // how much a frequent word may be further off
+
+struct swipe_key {
+    uint32_t cp;
+    float x, y;
+};
+
+static const struct lexicon *lexicon;
+static float unit = 1;
+static struct swipe_key keys[SWIPE_MAX_KEYS];
+static size_t keycount;
+static float px[SWIPE_MAX_POINTS], py[SWIPE_MAX_POINTS];
+static size_t pointcount;
+static float endx, endy; // latest point, even if too close to be recorded
+
+/* Decoding state. rows[i][j] is the lowest total distance of the first i + 1
+ * letters of the current prefix to the path, with letter i at point j or
+ * before. */
+static float rows[LEXICON_WORD_MAX][SWIPE_MAX_POINTS];
+static const struct swipe_key *word[LEXICON_WORD_MAX];
+static struct swipe_candidate *results;
+static size_t resultcount, resultmax;
+
+void
+swipe_set_lexicon(const struct lexicon *lx)
+{
+    lexicon = lx;
+}
+
+void
+swipe_begin(float key_height)
+{
+    unit = key_height > 0 ? key_height : 1;
+    keycount = 0;
+    pointcount = 0;
+}
+
+void
+swipe_add_key(uint32_t cp, float x, float y)
+{
+    for (size_t i = 0; i < keycount; i++) {
+        if (keys[i].cp == cp)
+            return; // the first one wins, layouts rarely repeat letters
+    }
+    if (keycount == SWIPE_MAX_KEYS)
+        return;
+    keys[keycount++] = (struct swipe_key){cp, x / unit, y / unit};
+}
+
+void
+swipe_add_point(float x, float y)
+{
+    endx = x / unit;
+    endy = y / unit;
+    if (pointcount && hypotf(endx - px[pointcount - 1],
+                             endy - py[pointcount - 1]) < MIN_SPACING)
+        return;
+    if (pointcount == SWIPE_MAX_POINTS) {
+        for (size_t i = 1; i < SWIPE_MAX_POINTS / 2; i++) {
+            px[i] = px[2 * i];
+            py[i] = py[2 * i];
+        }
+        pointcount = SWIPE_MAX_POINTS / 2;
+    }
+    px[pointcount] = endx;
+    py[pointcount] = endy;
+    pointcount++;
+}
+
+static const struct swipe_key *
+swipe_key(uint32_t cp)
+{
+    for (size_t i = 0; i < keycount; i++) {
+        if (keys[i].cp == cp)
+            return &keys[i];
+    }
+    return NULL;
+}
+
+static float
+distance(const struct swipe_key *k, size_t j)
+{
+    return hypotf(k->x - px[j], k->y - py[j]);
+}
+
+static float
+segment_distance(float x, float y, const struct swipe_key *a,
+                 const struct swipe_key *b)
+{
+    float dx = b->x - a->x, dy = b->y - a->y;
+    float len2 = dx * dx + dy * dy;
+    float t = len2 > 0 ? ((x - a->x) * dx + (y - a->y) * dy) / len2 : 0;
+    if (t < 0)
+        t = 0;
+    else if (t > 1)
+        t = 1;
+    return hypotf(x - (a->x + t * dx), y - (a->y + t * dy));
+}
+
+/* A word of len letters whose letters are aligned to the path with the given
+ * total distance */
+static void
+swipe_score(size_t len, float alignment, uint16_t freq)
+{
+    // the path must also stay close to the line through the letters, or
+    // short words would match any path between their first and last letter
+    float deviation = 0;
+    for (size_t j = 0; j < pointcount; j++) {
+        float best = INFINITY;
+        for (size_t i = 0; i + 1 < len; i++) {
+            float d = segment_distance(px[j], py[j], word[i], word[i + 1]);
+            if (d < best)
+                best = d;
+        }
+        deviation += best;
+    }
+
+    float score = alignment / len + deviation / pointcount -
+                  FREQ_WEIGHT * freq / 65535.0f;
+    if (resultcount == resultmax && score >= results[resultcount - 1].score)
+        return;
+
+    size_t pos = resultcount < resultmax ? resultcount++ : resultcount - 1;
+    while (pos > 0 && results[pos - 1].score > score) {
+        results[pos] = results[pos - 1];
+        pos--;
+    }
+    char *w = results[pos].word;
+    for (size_t i = 0; i < len; i++)
+        w += utf8_encode(w, word[i]->cp);
+    *w = '\0';
+    results[pos].score = score;
+}
+
+static void
+swipe_visit(const struct lexicon_node *n, size_t depth)
+{
+    const struct lexicon_node *c = lexicon->nodes + n->children;
+    size_t last = pointcount - 1;
+
+    for (uint16_t ci = 0; ci < n->childcount; ci++, c++) {
+        const struct swipe_key *k = swipe_key(c->cp);
+        float *row = rows[depth];
+        if (!k)
+            continue;
+
+        if (depth == 0) {
+            float d = distance(k, 0);
+            if (d > MAX_END_DISTANCE)
+                continue;
+            for (size_t j = 0; j < pointcount; j++)
+                row[j] = d;
+        } else {
+            const float *prev = rows[depth - 1];
+            float best = INFINITY;
+            for (size_t j = 0; j < pointcount; j++) {
+                float m = prev[j] + distance(k, j);
+                if (m < best)
+                    best = m;
+                row[j] = best;
+            }
+            // distances only add up, nothing below here can do better
+            if (row[last] > MAX_END_DISTANCE + MAX_MEAN_DISTANCE * depth)
+                continue;
+        }
+        word[depth] = k;
+
+        if (c->freq && depth > 0) {
+            float d = distance(k, last);
+            if (d <= MAX_END_DISTANCE)
+                swipe_score(depth + 1, rows[depth - 1][last] + d, c->freq);
+        }
+        if (c->childcount && depth + 1 < LEXICON_WORD_MAX)
+            swipe_visit(c, depth + 1);
+    }
+}
+
+size_t
+swipe_decode(struct swipe_candidate *out, size_t max)
+{
+    if (!lexicon || !max)
+        return 0;
+    if (pointcount &&
+        (px[pointcount - 1] != endx || py[pointcount - 1] != endy)) {
+        if (pointcount == SWIPE_MAX_POINTS)
+            pointcount--;
+        px[pointcount] = endx;
+        py[pointcount] = endy;
+        pointcount++;
+    }
+    if (pointcount < 2)
+        return 0;
+
+    results = out;
+    resultcount = 0;
+    resultmax = max < SWIPE_CANDIDATES ? max : SWIPE_CANDIDATES;
+    swipe_visit(&lexicon->nodes[0], 0);
+    return resultcount;
+}
@@ -0,0 +1,46 @@
+#ifndef __SWIPE_H
+#define __SWIPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lexicon.h"
+
+/* Swipe typing decoder
+ *
+ * A swipe is recorded as a path of points and, when the finger lifts, matched
+ * against every word of the lexicon whose letters are all on the keyboard, by
+ * walking the trie. A word matches when its first and last letters lie near
+ * the ends of the path and the letters in between are passed in order; the
+ * alignment of each prefix is computed once, from that of its parent node,
+ * and subtrees whose prefix strays too far from the path are skipped. Words
+ * are then ranked by how closely the path follows the line through their
+ * letters, and by frequency.
+ *
+ * Recording never allocates: points closer than a quarter key to the previous
+ * one are skipped, and when the path is full every other point is dropped.
+ * Distances are measured in key heights.
+ */
+
+#define SWIPE_MAX_KEYS 128
+#define SWIPE_MAX_POINTS 128
+#define SWIPE_CANDIDATES 5
+
+struct swipe_candidate {
+	char word[LEXICON_WORD_MAX * 4 + 1];
+	float score; // lower is better
+};
+
+void swipe_set_lexicon(const struct lexicon *lx);
+
+/* Start a new swipe: unit is the height of a key, keys are added next */
+void swipe_begin(float unit);
+/* A key that types the letter cp, centred on x, y */
+void swipe_add_key(uint32_t cp, float x, float y);
+void swipe_add_point(float x, float y);
+
+/* Rank the words matching the path, best first. Returns how many were found,
+ * at most max (and SWIPE_CANDIDATES). */
+size_t swipe_decode(struct swipe_candidate *out, size_t max);
+
+#endif
@@ -0,0 +1,576 @@
+/* Packs the keymaps of KEYMAP for layoutset.c (see keymappack.h) and writes
+ * them to standard output as a header. Run by the Makefile, with sizes
+ * reported to standard error.
+ *
+ * It also combines the keymaps into keymaps with one XKB group each, so that
+ * layouts are switched by the group alone. XKB has no more than four groups:
+ * the first keymap (latin) is group 1 of every combined keymap, the others
+ * follow three at a time in their order. */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keymappack.h"
+
+#ifndef KEYMAP
+#error "make sure to define KEYMAP"
+#endif
+#include KEYMAP
+
+#define MAX_SECTIONS 1024
+#define MAX_GROUPS 4
+#define MAX_COMBINED ((NUMKEYMAPS + MAX_GROUPS - 3) / (MAX_GROUPS - 1))
+#define MAX_STATEMENTS 1024
+#define HASH_BITS 16
+#define MAX_CHAIN 512 // candidates tried per position
+
+struct section {
+    const char *text;
+    size_t length;
+};
+
+static struct section sections[MAX_SECTIONS];
+static size_t sectioncount;
+static uint16_t parts[MAX_SECTIONS];
+static size_t partcount;
+static uint32_t first_part[NUMKEYMAPS + MAX_COMBINED + 1];
+static int combined_groups[MAX_COMBINED][MAX_GROUPS];
+static size_t combinedcount;
+
+struct buf {
+    char *s;
+    size_t len, size;
+};
+
+/* A statement of an xkb_symbols section, without its semicolon */
+struct statement {
+    const char *s;
+    size_t n;
+};
+
+struct symbols {
+    const char *body, *end; // after the opening brace, at the closing one
+    struct statement statements[MAX_STATEMENTS];
+    size_t count;
+};
+
+static void
+add_part(const char *text, size_t length)
+{
+    size_t i;
+    for (i = 0; i < sectioncount; i++) {
+        if (sections[i].length == length &&
+            memcmp(sections[i].text, text, length) == 0)
+            break;
+    }
+    if (i == sectioncount) {
+        if (sectioncount == MAX_SECTIONS) {
+            fprintf(stderr, "packkeymaps: too many sections\n");
+            exit(1);
+        }
+        sections[sectioncount++] = (struct section){text, length};
+    }
+    if (partcount == MAX_SECTIONS) {
+        fprintf(stderr, "packkeymaps: too many sections\n");
+        exit(1);
+    }
+    parts[partcount++] = i;
+}
+
+/* Split a keymap before each of its top level xkb_ sections, so that the
+ * first part is "xkb_keymap {" and the last one ends with its closing brace */
+static void
+split_keymap(const char *keymap)
+{
+    const char *start = keymap;
+    bool quoted = false;
+    int depth = 0;
+    for (const char *p = keymap; *p; p++) {
+        if (*p == '"')
+            quoted = !quoted;
+        else if (quoted)
+            continue;
+        else if (*p == '{')
+            depth++;
+        else if (*p == '}')
+            depth--;
+        else if (depth == 1 && p > start && strncmp(p, "xkb_", 4) == 0) {
+            add_part(start, p - start);
+            start = p;
+        }
+    }
+    add_part(start, strlen(start));
+}
+
+static void
+buf_add(struct buf *b, const char *s, size_t n)
+{
+    if (b->len + n + 1 > b->size) {
+        b->size = (b->len + n + 1) * 2;
+        b->s = realloc(b->s, b->size);
+        if (!b->s) {
+            perror("packkeymaps");
+            exit(1);
+        }
+    }
+    memcpy(b->s + b->len, s, n);
+    b->len += n;
+    b->s[b->len] = '\0';
+}
+
+static void
+buf_str(struct buf *b, const char *s)
+{
+    buf_add(b, s, strlen(s));
+}
+
+static bool
+is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+static bool
+same_but_space(const char *a, size_t an, const char *b, size_t bn)
+{
+    size_t i = 0, j = 0;
+    for (;;) {
+        while (i < an && is_space(a[i]))
+            i++;
+        while (j < bn && is_space(b[j]))
+            j++;
+        if (i == an || j == bn)
+            return i == an && j == bn;
+        if (a[i++] != b[j++])
+            return false;
+    }
+}
+
+static size_t
+count_char(const char *s, char c)
+{
+    size_t n = 0;
+    for (; (s = strchr(s, c)); s++)
+        n++;
+    return n;
+}
+
+/* Find the top level xkb_symbols section of a keymap and split its body into
+ * statements; false if it has none */
+static bool
+parse_symbols(const char *keymap, struct symbols *sym)
+{
+    bool quoted = false;
+    int depth = 0;
+    const char *p, *section = NULL, *start = NULL;
+
+    sym->body = NULL;
+    sym->count = 0;
+    for (p = keymap; *p; p++) {
+        if (*p == '"')
+            quoted = !quoted;
+        if (quoted || *p == '"')
+            continue;
+        if (depth == 1 && !section && strncmp(p, "xkb_symbols", 11) == 0) {
+            section = p;
+        } else if (*p == '{') {
+            if (++depth == 2 && section && !sym->body)
+                start = sym->body = p + 1;
+        } else if (*p == '}') {
+            if (depth-- == 2 && sym->body)
+                break;
+        } else if (*p == ';' && depth == 2 && sym->body) {
+            while (start < p && is_space(*start))
+                start++;
+            if (start < p) {
+                if (sym->count == MAX_STATEMENTS)
+                    return false;
+                sym->statements[sym->count++] =
+                    (struct statement){start, p - start};
+            }
+            start = p + 1;
+        }
+    }
+    sym->end = p;
+    return sym->body && *p == '}';
+}
+
+/* The name of a key statement, "<AC01>" of key <AC01> { ... }, or NULL */
+static const char *
+key_name(const struct statement *st, size_t *len)
+{
+    if (st->n < 4 || strncmp(st->s, "key", 3) != 0 || !is_space(st->s[3]))
+        return NULL;
+    const char *n = memchr(st->s, '<', st->n);
+    const char *e = n ? memchr(n, '>', st->n - (n - st->s)) : NULL;
+    if (!e)
+        return NULL;
+    *len = e + 1 - n;
+    return n;
+}
+
+/* What is between the braces of a key statement */
+static void
+key_body(const struct statement *st, const char **body, size_t *len)
+{
+    const char *b = memchr(st->s, '{', st->n), *e = st->s + st->n;
+    while (e > b && e[-1] != '}')
+        e--;
+    *body = b ? b + 1 : st->s;
+    *len = b && e > b ? e - 1 - *body : 0;
+}
+
+/* Write a key body defining group 1 for the given group instead: the levels
+ * alone or "symbols[Group1]" become "symbols[GroupN]", "type" "type[GroupN]" */
+static void
+add_group_body(struct buf *b, const char *body, size_t len, int group)
+{
+    char g[32];
+    size_t i = 0;
+    bool first = true;
+    while (i < len) {
+        while (i < len && is_space(body[i]))
+            i++;
+        size_t start = i;
+        int depth = 0;
+        bool quoted = false;
+        for (; i < len; i++) {
+            if (body[i] == '"')
+                quoted = !quoted;
+            else if (quoted)
+                continue;
+            else if (body[i] == '[')
+                depth++;
+            else if (body[i] == ']')
+                depth--;
+            else if (body[i] == ',' && !depth)
+                break;
+        }
+        const char *item = body + start;
+        size_t n = i - start;
+        i++; // the comma
+        if (!n)
+            continue;
+
+        buf_str(b, first ? " " : ", ");
+        first = false;
+        if (item[0] == '[') {
+            snprintf(g, sizeof(g), "symbols[Group%d]= ", group + 1);
+            buf_str(b, g);
+            buf_add(b, item, n);
+        } else if (n > 4 && strncmp(item, "type", 4) == 0 &&
+                   (is_space(item[4]) || item[4] == '=')) {
+            const char *eq = memchr(item, '=', n);
+            snprintf(g, sizeof(g), "type[Group%d]=", group + 1);
+            buf_str(b, g);
+            buf_add(b, eq + 1, n - (eq + 1 - item));
+        } else {
+            const char *br = memchr(item, '[', n);
+            if (br && n - (br - item) >= 8 &&
+                strncasecmp(br, "[Group1]", 8) == 0) {
+                buf_add(b, item, br - item);
+                snprintf(g, sizeof(g), "[Group%d]", group + 1);
+                buf_str(b, g);
+                buf_add(b, br + 8, n - (br + 8 - item));
+            } else {
+                buf_add(b, item, n);
+            }
+        }
+    }
+    buf_str(b, " ");
+}
+
+/* A keymap with the given keymaps as its groups: all but the symbols are
+ * taken from the first one, which the others must match. Keys that are the
+ * same in all groups are only defined for group 1, which XKB then uses in
+ * every group. NULL if they can't be combined. */
+static char *
+combine(const int *keymap, size_t count)
+{
+    static struct symbols sym[MAX_GROUPS];
+    struct buf b = {0};
+    char line[64];
+
+    for (size_t g = 0; g < count; g++) {
+        const char *k = keymaps[keymap[g]], *k0 = keymaps[keymap[0]];
+        if (!parse_symbols(k, &sym[g]))
+            return NULL;
+        size_t before = sym[g].body - k;
+        if (before != (size_t)(sym[0].body - k0) ||
+            strncmp(k, k0, before) != 0 || strcmp(sym[g].end, sym[0].end))
+            return NULL;
+    }
+
+    buf_add(&b, keymaps[keymap[0]], sym[0].body - keymaps[keymap[0]]);
+    buf_str(&b, "\n");
+    for (size_t g = 0; g < count; g++) {
+        snprintf(line, sizeof(line), "        name[group%zu]=\"wvkbd %s\";\n",
+                 g + 1, keymap_names[keymap[g]]);
+        buf_str(&b, line);
+    }
+
+    // every key, in the order they first appear
+    for (size_t g = 0; g < count; g++) {
+        for (size_t s = 0; s < sym[g].count; s++) {
+            const struct statement *st = &sym[g].statements[s];
+            size_t len, blen[MAX_GROUPS];
+            const char *name = key_name(st, &len), *body[MAX_GROUPS];
+            bool seen = false, same = true;
+            if (!name)
+                continue;
+
+            for (size_t h = 0; h < count; h++) {
+                body[h] = NULL;
+                for (size_t t = 0; t < sym[h].count; t++) {
+                    size_t l;
+                    const char *n = key_name(&sym[h].statements[t], &l);
+                    if (n && l == len && strncmp(n, name, len) == 0) {
+                        key_body(&sym[h].statements[t], &body[h], &blen[h]);
+                        break;
+                    }
+                }
+                if (h < g && body[h])
+                    seen = true;
+                if (!body[h] || !body[0] ||
+                    !same_but_space(body[h], blen[h], body[0], blen[0]))
+                    same = false;
+            }
+            if (seen)
+                continue;
+
+            buf_str(&b, "        ");
+            if (same) {
+                buf_add(&b, st->s, st->n);
+                buf_str(&b, ";\n");
+                continue;
+            }
+            buf_str(&b, "key ");
+            buf_add(&b, name, len);
+            buf_str(&b, " {");
+            // a key missing from a group is left empty there, rather than
+            // wrapping around to group 1
+            for (size_t h = 0; h < count; h++) {
+                if (h)
+                    buf_str(&b, ",\n           ");
+                if (body[h])
+                    add_group_body(&b, body[h], blen[h], h);
+                else
+                    add_group_body(&b, "[ NoSymbol ]", 12, h);
+            }
+            buf_str(&b, "};\n");
+        }
+    }
+
+    // then the rest (modifier maps) of the first keymap, and what the others
+    // have that it hasn't
+    for (size_t g = 0; g < count; g++) {
+        for (size_t s = 0; s < sym[g].count; s++) {
+            const struct statement *st = &sym[g].statements[s];
+            size_t len;
+            bool seen = false;
+            if (key_name(st, &len) || strncmp(st->s, "name[", 5) == 0)
+                continue;
+            for (size_t h = 0; h < g && !seen; h++) {
+                for (size_t t = 0; t < sym[h].count && !seen; t++)
+                    seen = same_but_space(st->s, st->n, sym[h].statements[t].s,
+                                          sym[h].statements[t].n);
+            }
+            if (seen)
+                continue;
+            buf_str(&b, "        ");
+            buf_add(&b, st->s, st->n);
+            buf_str(&b, ";\n");
+        }
+    }
+    buf_str(&b, sym[0].end);
+
+    // the keys that were the same in all groups include the Copy key, whose
+    // two codepoints are all create_and_upload_keymap fills in
+    if (count_char(b.s, '%') != count_char(keymaps[keymap[0]], '%')) {
+        free(b.s);
+        return NULL;
+    }
+    return b.s;
+}
+
+static uint32_t
+hash3(const uint8_t *p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >>
+           (32 - HASH_BITS);
+}
+
+/* Greedy LZSS over hash chains of the three byte prefixes; out must have room
+ * for length * 9 / 8 + 1 bytes */
+static size_t
+compress(const uint8_t *in, size_t length, uint8_t *out)
+{
+    static int32_t head[1 << HASH_BITS];
+    int32_t *prev = malloc(length * sizeof(*prev));
+    size_t i = 0, o = 0, flags = 0;
+    int bit = 8;
+
+    if (!prev) {
+        perror("packkeymaps");
+        exit(1);
+    }
+    memset(head, -1, sizeof(head));
+    while (i < length) {
+        if (bit == 8) {
+            flags = o++;
+            out[flags] = 0;
+            bit = 0;
+        }
+
+        size_t best = 0, best_dist = 0;
+        if (i + KEYMAPPACK_MIN_MATCH <= length) {
+            int chain = 0;
+            for (int32_t c = head[hash3(in + i)];
+                 c >= 0 && i - c <= KEYMAPPACK_WINDOW && chain < MAX_CHAIN;
+                 c = prev[c], chain++) {
+                size_t n = 0;
+                while (n < KEYMAPPACK_MAX_MATCH && i + n < length &&
+                       in[c + n] == in[i + n])
+                    n++;
+                if (n > best) {
+                    best = n;
+                    best_dist = i - c;
+                    if (n == KEYMAPPACK_MAX_MATCH)
+                        break;
+                }
+            }
+        }
+
+        size_t step = 1;
+        if (best >= KEYMAPPACK_MIN_MATCH) {
+            out[o++] = (best_dist - 1) & 0xFF;
+            out[o++] = ((best_dist - 1) >> 8) << 4 |
+                       (best - KEYMAPPACK_MIN_MATCH);
+            step = best;
+        } else {
+            out[flags] |= 1 << bit;
+            out[o++] = in[i];
+        }
+        bit++;
+
+        for (; step; step--, i++) {
+            if (i + KEYMAPPACK_MIN_MATCH <= length) {
+                uint32_t h = hash3(in + i);
+                prev[i] = head[h];
+                head[h] = i;
+            }
+        }
+    }
+    free(prev);
+    return o;
+}
+
+int
+main(int argc, char *argv[])
+{
+    size_t total = 0, unique = 0, packed = 0, combined_total = 0;
+
+    for (size_t k = 0; k < NUMKEYMAPS; k++) {
+        first_part[k] = partcount;
+        split_keymap(keymaps[k]);
+        total += strlen(keymaps[k]);
+    }
+
+    for (int k = 1; k < NUMKEYMAPS;) {
+        int *groups = combined_groups[combinedcount];
+        size_t count = 1;
+        groups[0] = 0;
+        for (; count < MAX_GROUPS && k < NUMKEYMAPS; k++)
+            groups[count++] = k;
+        for (size_t g = count; g < MAX_GROUPS; g++)
+            groups[g] = -1;
+
+        char *keymap = combine(groups, count);
+        if (!keymap) {
+            fprintf(stderr, "packkeymaps: keymaps %s to %s differ in more "
+                    "than their symbols, not combining them\n",
+                    keymap_names[groups[0]], keymap_names[groups[count - 1]]);
+            continue;
+        }
+        first_part[NUMKEYMAPS + combinedcount++] = partcount;
+        split_keymap(keymap);
+        combined_total += strlen(keymap);
+    }
+    first_part[NUMKEYMAPS + combinedcount] = partcount;
+
+    printf("/* Generated by tools/packkeymaps.c from %s, do not edit */\n\n",
+           KEYMAP);
+    printf("#define NUMKEYMAPS %d\n", NUMKEYMAPS);
+    printf("#define NUMCOMBINED %zu\n\n", combinedcount);
+    printf("static const char *keymap_names[] = {");
+    for (size_t k = 0; k < NUMKEYMAPS; k++)
+        printf("%s\"%s\"", k ? ", " : "", keymap_names[k]);
+    printf("};\n\n");
+
+    struct keymappack_section packs[MAX_SECTIONS];
+    printf("static const uint8_t keymap_data[] = {");
+    for (size_t s = 0; s < sectioncount; s++) {
+        uint8_t *out = malloc(sections[s].length * 9 / 8 + 1);
+        if (!out) {
+            perror("packkeymaps");
+            return 1;
+        }
+        size_t size = compress((const uint8_t *)sections[s].text,
+                               sections[s].length, out);
+        for (size_t i = 0; i < size; i++) {
+            size_t n = packed + i;
+            printf("%s%u", !n ? "\n    " : n % 20 ? "," : ",\n    ", out[i]);
+        }
+        packs[s] = (struct keymappack_section){packed, size,
+                                               sections[s].length};
+        packed += size;
+        unique += sections[s].length;
+        free(out);
+    }
+    printf("\n};\n\n");
+
+    printf("static const struct keymappack_section keymap_sections[] = {\n");
+    for (size_t s = 0; s < sectioncount; s++)
+        printf("    {%u, %u, %u},\n", packs[s].offset, packs[s].size,
+               packs[s].length);
+    printf("};\n\n");
+
+    printf("static const uint16_t keymap_parts[] = {");
+    for (size_t i = 0; i < partcount; i++)
+        printf("%s%u", i ? ", " : "", parts[i]);
+    printf("};\n\n");
+
+    printf("static const uint32_t keymap_first_part[] = {");
+    for (size_t k = 0; k <= NUMKEYMAPS + combinedcount; k++)
+        printf("%s%u", k ? ", " : "", first_part[k]);
+    printf("};\n\n");
+
+    printf("static const struct keymappack keymap_pack = {\n"
+           "    .data = keymap_data,\n"
+           "    .sections = keymap_sections,\n"
+           "    .parts = keymap_parts,\n"
+           "    .first_part = keymap_first_part,\n"
+           "    .keymapcount = NUMKEYMAPS + NUMCOMBINED,\n"
+           "};\n\n");
+
+    // one entry at least, C has no empty arrays
+    printf("static const int16_t keymap_combined_groups[][KBD_MAX_GROUPS] = "
+           "{\n");
+    for (size_t c = 0; c < combinedcount || c == 0; c++) {
+        printf("    {");
+        for (size_t g = 0; g < MAX_GROUPS; g++)
+            printf("%s%d", g ? ", " : "",
+                   c < combinedcount ? combined_groups[c][g] : -1);
+        printf("},\n");
+    }
+    printf("};\n");
+
+    fprintf(stderr,
+            "packkeymaps: %d keymaps of %zu bytes and %zu combined of %zu "
+            "bytes, %zu unique sections of %zu bytes, packed to %zu bytes\n",
+            NUMKEYMAPS, total, combinedcount, combined_total, sectioncount,
+            unique, packed);
+    return 0;
+}
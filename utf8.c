@@ -0,0 +1,56 @@
+#include "utf8.h"
+
+size_t
+utf8_decode(const char *s, uint32_t *cp)
+{
+    const unsigned char *u = (const unsigned char *)s;
+    size_t len;
+
+    if (u[0] < 0x80) {
+        *cp = u[0];
+        return 1;
+    } else if ((u[0] & 0xE0) == 0xC0) {
+        *cp = u[0] & 0x1F;
+        len = 2;
+    } else if ((u[0] & 0xF0) == 0xE0) {
+        *cp = u[0] & 0x0F;
+        len = 3;
+    } else if ((u[0] & 0xF8) == 0xF0) {
+        *cp = u[0] & 0x07;
+        len = 4;
+    } else {
+        *cp = u[0];
+        return 1;
+    }
+    for (size_t i = 1; i < len; i++) {
+        if ((u[i] & 0xC0) != 0x80) {
+            *cp = u[0];
+            return 1;
+        }
+        *cp = (*cp << 6) | (u[i] & 0x3F);
+    }
+    return len;
+}
+
+size_t
+utf8_encode(char *s, uint32_t cp)
+{
+    if (cp < 0x80) {
+        s[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        s[0] = 0xC0 | (cp >> 6);
+        s[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    } else if (cp < 0x10000) {
+        s[0] = 0xE0 | (cp >> 12);
+        s[1] = 0x80 | ((cp >> 6) & 0x3F);
+        s[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    s[0] = 0xF0 | (cp >> 18);
+    s[1] = 0x80 | ((cp >> 12) & 0x3F);
+    s[2] = 0x80 | ((cp >> 6) & 0x3F);
+    s[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
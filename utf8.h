@@ -0,0 +1,13 @@
+#ifndef __UTF8_H
+#define __UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Decode the code point at s, returns the number of bytes it takes. Invalid
+ * bytes decode as themselves. */
+size_t utf8_decode(const char *s, uint32_t *cp);
+/* Encode a code point, returns the number of bytes written (at most 4) */
+size_t utf8_encode(char *s, uint32_t cp);
+
+#endif